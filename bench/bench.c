@@ -0,0 +1,339 @@
+#include "meval/meval.h"
+#include "bench_alloc.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/*
+ * Benchmarks the compile and evaluation hot paths over a small corpus of expressions.
+ *
+ * Every result is one tab separated line, so the output of two releases can be diffed, or loaded into a spreadsheet:
+ *     case  bench  vars  iterations  ns_per_op  allocs_per_op  ops_per_sec  mb_per_sec
+ * 'allocs_per_op' counts calls to 'MEVAL_MALLOC' and 'MEVAL_REALLOCARRAY', 'mb_per_sec' is input text consumed per
+ * second and is 0 for the benches that do not read the text.
+ */
+
+#define BENCH_DEFAULT_MIN_TIME_MS 200
+#define BENCH_MAX_VARS 100
+#define BENCH_LONG_TERMS 200
+#define BENCH_NESTED_DEPTH 32
+
+uint64_t bench_allocations_count = 0;
+
+void* bench_malloc(size_t size) {
+    bench_allocations_count++;
+    return malloc(size);
+}
+
+void* bench_reallocarray(void* ptr, size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX/size) {
+        return NULL;
+    }
+    bench_allocations_count++;
+    return realloc(ptr, nmemb*size);
+}
+
+void bench_free(void* ptr) {
+    free(ptr);
+}
+
+typedef struct {
+    const char* name;
+    char* expr;
+    MEvalVarArr vars;
+    MEvalVarEnv* env; // The same variables.
+    double* values; // The values of 'vars', in the same order.
+} BenchCase;
+
+typedef struct {
+    uint64_t iterations;
+    double elapsed_ns;
+    uint64_t allocations_count;
+} BenchResult;
+
+enum BENCH {BENCH_ONESHOT, BENCH_COMPILE, BENCH_EVAL, BENCH_EVAL_ENV, BENCH_EVAL_BOUND, BENCH_COUNT};
+static const char* bench_names[BENCH_COUNT] = {"oneshot", "compile", "eval", "eval_env", "eval_bound"};
+
+static volatile double bench_sink; // Keeps the compiler from dropping the work being measured.
+
+double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+/* Appends to a growing heap string, exits on failure, as a benchmark has nothing sensible to fall back to */
+void append_str(char** str, size_t* len, size_t* capacity, const char* text) {
+    size_t text_len = strlen(text);
+    if (*len + text_len + 1 > *capacity) {
+        size_t new_capacity = (*capacity == 0 ? 256 : *capacity);
+        while (*len + text_len + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char* new_str = realloc(*str, new_capacity);
+        if (new_str == NULL) {
+            fprintf(stderr, "meval-bench: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        *str = new_str;
+        *capacity = new_capacity;
+    }
+    memcpy(*str + *len, text, text_len + 1);
+    *len += text_len;
+}
+
+void add_var(BenchCase* bench_case, const char* name, double value) {
+    MEvalVar var = {0};
+    snprintf(var.name, MEVAL_VAR_NAME_MAX_LEN, "%s", name);
+    var.name_char_count = strlen(var.name);
+    var.value = value;
+    MEvalError error;
+    if (bench_case->env == NULL) {
+        bench_case->env = meval_var_env_create(0, &error);
+    }
+    if (!meval_append_variable(&bench_case->vars, var) || bench_case->env == NULL
+            || meval_var_env_set(bench_case->env, var.name, value, &error) == MEVAL_VAR_ENV_NO_HANDLE) {
+        fprintf(stderr, "meval-bench: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* '(xaa*c0) + (xab*c1) - ...', mixing the four arithmetic operators over 'vars_count' variables */
+BenchCase make_vars_case(const char* name, uint32_t vars_count) {
+    static const char* ops[4] = {"+", "-", "*", "/"};
+    BenchCase bench_case = {.name=name};
+    size_t len = 0, capacity = 0;
+    char term[64];
+    for (uint32_t i = 0; i < vars_count; i++) {
+        char var_name[4] = {'x', 'a' + i/26, 'a' + i%26, '\0'}; // Names are letters only.
+        add_var(&bench_case, var_name, 1.0 + 0.25*i);
+        snprintf(term, sizeof(term), "%s(%s*%u.5%s%u)", i == 0 ? "" : ops[i%2], var_name, i + 1, ops[2 + i%2], i%7 + 1);
+        append_str(&bench_case.expr, &len, &capacity, term);
+    }
+    return bench_case;
+}
+
+BenchCase make_long_case(const char* name) {
+    static const char* var_names[4] = {"a", "b", "c", "d"};
+    BenchCase bench_case = {.name=name};
+    for (uint32_t i = 0; i < 4; i++) {
+        add_var(&bench_case, var_names[i], 0.5 + i);
+    }
+    size_t len = 0, capacity = 0;
+    char term[64];
+    for (uint32_t i = 0; i < BENCH_LONG_TERMS; i++) {
+        snprintf(term, sizeof(term), "%s%s*%u.125^2/(%s+%u)", i == 0 ? "" : (i%3 == 0 ? " - " : " + "),
+                 var_names[i%4], i%10, var_names[(i + 1)%4], i%5 + 1);
+        append_str(&bench_case.expr, &len, &capacity, term);
+    }
+    return bench_case;
+}
+
+BenchCase make_nested_case(const char* name) {
+    BenchCase bench_case = {.name=name};
+    add_var(&bench_case, "x", 0.75);
+    size_t len = 0, capacity = 0;
+    for (uint32_t i = 0; i < BENCH_NESTED_DEPTH; i++) {
+        append_str(&bench_case.expr, &len, &capacity, "(x+");
+    }
+    append_str(&bench_case.expr, &len, &capacity, "1");
+    char tail[32];
+    for (uint32_t i = 0; i < BENCH_NESTED_DEPTH; i++) {
+        snprintf(tail, sizeof(tail), ")*%s", i%2 == 0 ? "0.5" : "x");
+        append_str(&bench_case.expr, &len, &capacity, tail);
+    }
+    return bench_case;
+}
+
+BenchCase make_fixed_case(const char* name, const char* expr, const char* var_name, double value) {
+    BenchCase bench_case = {.name=name};
+    size_t len = 0, capacity = 0;
+    append_str(&bench_case.expr, &len, &capacity, expr);
+    if (var_name != NULL) {
+        add_var(&bench_case, var_name, value);
+    }
+    return bench_case;
+}
+
+void free_case(BenchCase* bench_case) {
+    free(bench_case->expr);
+    free(bench_case->values);
+    meval_free_variable_arr(&bench_case->vars);
+    meval_var_env_free(&bench_case->env);
+}
+
+void check_error(const BenchCase* bench_case, const char* stage, const MEvalError* error) {
+    if (error->type != MEVAL_NO_ERROR) {
+        fprintf(stderr, "meval-bench: case '%s' failed to %s at %u: %s\n", bench_case->name, stage, error->char_index, error->message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+double bench_sinh(void* userdata, double a) {
+    (void)userdata;
+    return sinh(a);
+}
+
+/*
+ * Registers names that extend built in names, and checks the built in names still lex as themselves, so a lexer
+ * regression fails the run rather than skewing the numbers.
+ */
+void check_registry_names(void) {
+    static const struct {const char* expr; double value;} checks[] = {
+        {"sin(1)", 0.8414709848078965}, {"sin 1", 0.8414709848078965}, {"sinh(1)", 1.1752011936438014},
+        {"pi*2", 6.2831853071795862}, {"e", 2.7182818284590451}, {"pie+ee", 15},
+    };
+    MEvalError error;
+    MEvalRegistry* registry = meval_registry_create(&error);
+    if (registry == NULL || !meval_registry_add_unary(registry, "sinh", bench_sinh, NULL, true, &error)
+            || !meval_registry_add_constant(registry, "pie", 7, &error) || !meval_registry_add_constant(registry, "ee", 8, &error)) {
+        fprintf(stderr, "meval-bench: registry setup failed: %s\n", error.message);
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < sizeof(checks)/sizeof(checks[0]); i++) {
+        MEvalCompiledExpr* compiled_expr = meval_var_compile_registry(checks[i].expr, registry, &error);
+        double value = error.type == MEVAL_NO_ERROR ? meval_var_eval_cexpr(compiled_expr, (MEvalVarArr){0}, &error) : NAN;
+        meval_free_compiled_expr(&compiled_expr);
+        if (error.type != MEVAL_NO_ERROR || fabs(value - checks[i].value) > 1e-12) {
+            fprintf(stderr, "meval-bench: registry check '%s' gave %.17g: %s\n", checks[i].expr, value, error.message);
+            exit(EXIT_FAILURE);
+        }
+    }
+    meval_registry_free(&registry);
+}
+
+/* Runs 'iterations' of one bench, the compiled expression is only used by the eval benches */
+double run_bench(enum BENCH bench, const BenchCase* bench_case, const MEvalCompiledExpr* compiled_expr, uint64_t iterations) {
+    MEvalError error;
+    double sum = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        switch (bench) {
+            case BENCH_ONESHOT:
+                sum += meval_var(bench_case->expr, bench_case->vars, &error);
+                break;
+            case BENCH_COMPILE: {
+                MEvalCompiledExpr* new_expr = meval_var_compile(bench_case->expr, &error);
+                sum += new_expr != NULL;
+                meval_free_compiled_expr(&new_expr);
+                break;
+            }
+            case BENCH_EVAL:
+                sum += meval_var_eval_cexpr(compiled_expr, bench_case->vars, &error);
+                break;
+            case BENCH_EVAL_ENV:
+                sum += meval_var_eval_cexpr_env(compiled_expr, bench_case->env, &error);
+                break;
+            case BENCH_EVAL_BOUND:
+                sum += meval_var_eval_bound_cexpr(compiled_expr, bench_case->values, &error);
+                break;
+            case BENCH_COUNT:
+                break;
+        }
+    }
+    return sum;
+}
+
+/* Doubles the iteration count until one run takes at least 'min_time_ns' */
+BenchResult measure(enum BENCH bench, const BenchCase* bench_case, const MEvalCompiledExpr* compiled_expr, double min_time_ns) {
+    BenchResult result = {0};
+    uint64_t iterations = 1;
+    while (true) {
+        uint64_t allocations_before = bench_allocations_count;
+        double start = now_ns();
+        bench_sink = run_bench(bench, bench_case, compiled_expr, iterations);
+        double elapsed = now_ns() - start;
+        if (elapsed >= min_time_ns || iterations >= (UINT64_C(1) << 40)) {
+            result.iterations = iterations;
+            result.elapsed_ns = elapsed;
+            result.allocations_count = bench_allocations_count - allocations_before;
+            return result;
+        }
+        // Aim straight for the target once the timer gives a usable reading.
+        uint64_t next = elapsed > 1e5 ? (uint64_t)(iterations*1.2*min_time_ns/elapsed) : iterations*8;
+        iterations = next > iterations*2 ? next : iterations*2;
+    }
+}
+
+void print_usage(const char* program_name) {
+    printf("Usage: %s [--min-time MS] [--filter TEXT]\n", program_name);
+    printf("Prints one tab separated line per case and bench, for diffing between releases.\n");
+}
+
+int main(int argc, char* argv[]) {
+    double min_time_ms = BENCH_DEFAULT_MIN_TIME_MS;
+    const char* filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    check_registry_names();
+
+    BenchCase cases[] = {
+        make_fixed_case("short", "2*x+1", "x", 3),
+        make_fixed_case("short_const", "5+4-(2/_6)", NULL, 0),
+        make_nested_case("nested"),
+        make_fixed_case("transcendental", "sin(x)^2+cos(x)^2+tan(x/3)*e^(_x)+log(x+2)-atan(x)*asin(x/4)+hypot(x, sin(x), 2)", "x", 0.5),
+        make_long_case("long"),
+        make_vars_case("vars_1", 1),
+        make_vars_case("vars_10", 10),
+        make_vars_case("vars_100", BENCH_MAX_VARS),
+    };
+    uint32_t cases_count = sizeof(cases)/sizeof(cases[0]);
+
+    printf("# libmeval %d.%d bench, min time %.0f ms\n", MEVAL_VERSION_MAJOR, MEVAL_VERSION_MINOR, min_time_ms);
+    printf("case\tbench\tvars\titerations\tns_per_op\tallocs_per_op\tops_per_sec\tmb_per_sec\n");
+    for (uint32_t c = 0; c < cases_count; c++) {
+        BenchCase* bench_case = &cases[c];
+        if (filter != NULL && strstr(bench_case->name, filter) == NULL) {
+            continue;
+        }
+        MEvalError error;
+        MEvalCompiledExpr* compiled_expr = meval_var_compile(bench_case->expr, &error);
+        check_error(bench_case, "compile", &error);
+        meval_var_bind_cexpr(compiled_expr, bench_case->vars, &error);
+        check_error(bench_case, "bind", &error);
+        // Bound to 'vars', so the bound benches take the values in the order of 'vars'.
+        uint32_t vars_count = bench_case->vars.elements_count;
+        bench_case->values = malloc((vars_count > 0 ? vars_count : 1)*sizeof(double));
+        if (bench_case->values == NULL) {
+            fprintf(stderr, "meval-bench: out of memory\n");
+            return EXIT_FAILURE;
+        }
+        for (uint32_t v = 0; v < vars_count; v++) {
+            bench_case->values[v] = bench_case->vars.arr_ptr[v].value;
+        }
+        meval_var(bench_case->expr, bench_case->vars, &error);
+        check_error(bench_case, "evaluate", &error);
+
+        size_t expr_len = strlen(bench_case->expr);
+        for (uint32_t b = 0; b < BENCH_COUNT; b++) {
+            BenchResult result = measure(b, bench_case, compiled_expr, min_time_ms*1e6);
+            double ns_per_op = result.elapsed_ns/result.iterations;
+            bool reads_text = b == BENCH_ONESHOT || b == BENCH_COMPILE;
+            printf("%s\t%s\t%u\t%llu\t%.1f\t%.2f\t%.0f\t%.2f\n", bench_case->name, bench_names[b], bench_case->vars.elements_count,
+                   (unsigned long long)result.iterations, ns_per_op, (double)result.allocations_count/result.iterations,
+                   1e9/ns_per_op, reads_text ? expr_len*1e3/ns_per_op : 0.0);
+            fflush(stdout);
+        }
+        meval_free_compiled_expr(&compiled_expr);
+    }
+    for (uint32_t c = 0; c < cases_count; c++) {
+        free_case(&cases[c]);
+    }
+    return EXIT_SUCCESS;
+}
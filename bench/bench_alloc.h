@@ -0,0 +1,13 @@
+#pragma once
+/*
+ * Counting replacements for 'MEVAL_MALLOC', 'MEVAL_REALLOCARRAY' and 'MEVAL_FREE', force included into 'src/meval.c'
+ * when it is built for the benchmark (see the 'bench' target in the Makefile).
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+extern uint64_t bench_allocations_count;
+
+void* bench_malloc(size_t size);
+void* bench_reallocarray(void* ptr, size_t nmemb, size_t size);
+void bench_free(void* ptr);
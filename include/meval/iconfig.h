@@ -14,7 +14,7 @@
 //       letter within it.
 // Note: A function or constant cannot contain digits, although this may change
 //       latter.
-// Note: A function or constant cannot be (or start with) '(' or ')', these
+// Note: A function or constant cannot be (or start with) '(', ')' or ',', these
 //       characters are reserved.
 
 /* Allow for implicit '(' in expressions, set to 1 to allow */
@@ -25,22 +25,74 @@ static double fn_cosec(double a) {return 1/sin(a);}
 static double fn_sec(double a) {return 1/cos(a);}
 static double fn_cot(double a) {return 1/tan(a);}
 
+/* Derivatives for gradients, given the operand 'a' and the function's 'result' */
+static double d_negate(double a, double result) {return -1;}
+static double d_sin(double a, double result) {return cos(a);}
+static double d_cos(double a, double result) {return -sin(a);}
+static double d_tan(double a, double result) {return 1 + result*result;}
+static double d_asin(double a, double result) {return 1/sqrt(1 - a*a);}
+static double d_acos(double a, double result) {return -1/sqrt(1 - a*a);}
+static double d_atan(double a, double result) {return 1/(1 + a*a);}
+static double d_cosec(double a, double result) {return -result/tan(a);}
+static double d_sec(double a, double result) {return result*tan(a);}
+static double d_cot(double a, double result) {return -(1 + result*result);}
+static double d_log(double a, double result) {return 1/a;}
+
+/* Bounds for interval evaluation, see 'interval_whole' and onwards in meval.c */
+static Interval i_negate(Interval a) {return (Interval){.lo=-a.hi, .hi=-a.lo, .maybe_nan=a.maybe_nan};}
+static Interval i_sin(Interval a) {return interval_periodic(a, sin, M_PI/2, -M_PI/2);}
+static Interval i_cos(Interval a) {return interval_periodic(a, cos, 0, M_PI);}
+static Interval i_tan(Interval a) {
+    if (interval_has_inf(a)) {
+        return interval_whole(true);
+    }
+    if (a.hi - a.lo >= M_PI || interval_has_periodic(a, M_PI/2, M_PI)) {
+        return interval_whole(a.maybe_nan);
+    }
+    return interval_increasing(a, tan);
+}
+static Interval i_asin(Interval a) {
+    if (a.hi < -1 || a.lo > 1) {
+        return interval_whole(true);
+    }
+    Interval domain = {.lo=fmax(a.lo, -1), .hi=fmin(a.hi, 1), .maybe_nan=a.maybe_nan || a.lo < -1 || a.hi > 1};
+    return interval_increasing(domain, asin);
+}
+static Interval i_acos(Interval a) {
+    if (a.hi < -1 || a.lo > 1) {
+        return interval_whole(true);
+    }
+    Interval domain = {.lo=fmax(a.lo, -1), .hi=fmin(a.hi, 1), .maybe_nan=a.maybe_nan || a.lo < -1 || a.hi > 1};
+    return interval_decreasing(domain, acos);
+}
+static Interval i_atan(Interval a) {return interval_increasing(a, atan);}
+static Interval i_cosec(Interval a) {return interval_div((Interval){.lo=1, .hi=1}, i_sin(a));}
+static Interval i_sec(Interval a) {return interval_div((Interval){.lo=1, .hi=1}, i_cos(a));}
+static Interval i_cot(Interval a) {return interval_div((Interval){.lo=1, .hi=1}, i_tan(a));}
+static Interval i_log(Interval a) {
+    if (a.hi < 0) {
+        return interval_whole(true);
+    }
+    Interval domain = {.lo=fmax(a.lo, 0), .hi=a.hi, .maybe_nan=a.maybe_nan || a.lo < 0};
+    return interval_increasing(domain, log);
+}
+
 // Enum 'UNARY_FUNCTION_NAMES', used as an index in the 'unary_fns' array.
 enum UNARY_FUNCTION_NAMES {UFN_NEGATE=0, UFN_SIN, UFN_COS, UFN_TAN, UFN_ASIN,
     UFN_ACOS, UFN_ATAN, UFN_COSEC, UFN_SEC, UFN_COT, UFN_LOG}; 
 static UnaryFn unary_fns[] = {
-//  function name    precedence     function pointer
-    {.name="_",     .precedence=7, .fnptr=fn_negate},
-    {.name="sin",   .precedence=7, .fnptr=sin},
-    {.name="cos",   .precedence=7, .fnptr=cos},
-    {.name="tan",   .precedence=7, .fnptr=tan},
-    {.name="asin",  .precedence=7, .fnptr=asin},
-    {.name="acos",  .precedence=7, .fnptr=acos},
-    {.name="atan",  .precedence=7, .fnptr=atan},
-    {.name="cosec", .precedence=7, .fnptr=fn_cosec},
-    {.name="sec",   .precedence=7, .fnptr=fn_sec},
-    {.name="cot",   .precedence=7, .fnptr=fn_cot},
-    {.name="log",   .precedence=7, .fnptr=log}
+//  function name    precedence     function pointer   derivative          interval bounds
+    {.name="_",     .precedence=7, .fnptr=fn_negate, .dfnptr=d_negate, .ifnptr=i_negate},
+    {.name="sin",   .precedence=7, .fnptr=sin,       .dfnptr=d_sin,    .ifnptr=i_sin},
+    {.name="cos",   .precedence=7, .fnptr=cos,       .dfnptr=d_cos,    .ifnptr=i_cos},
+    {.name="tan",   .precedence=7, .fnptr=tan,       .dfnptr=d_tan,    .ifnptr=i_tan},
+    {.name="asin",  .precedence=7, .fnptr=asin,      .dfnptr=d_asin,   .ifnptr=i_asin},
+    {.name="acos",  .precedence=7, .fnptr=acos,      .dfnptr=d_acos,   .ifnptr=i_acos},
+    {.name="atan",  .precedence=7, .fnptr=atan,      .dfnptr=d_atan,   .ifnptr=i_atan},
+    {.name="cosec", .precedence=7, .fnptr=fn_cosec,  .dfnptr=d_cosec,  .ifnptr=i_cosec},
+    {.name="sec",   .precedence=7, .fnptr=fn_sec,    .dfnptr=d_sec,    .ifnptr=i_sec},
+    {.name="cot",   .precedence=7, .fnptr=fn_cot,    .dfnptr=d_cot,    .ifnptr=i_cot},
+    {.name="log",   .precedence=7, .fnptr=log,       .dfnptr=d_log,    .ifnptr=i_log}
 };
 
 static double fn_add(double a, double b) {return a+b;}
@@ -56,25 +108,179 @@ static double fn_less_equal(double a, double b) {return a <= b;}
 static double fn_and(double a, double b) {return a && b;}
 static double fn_or(double a, double b) {return a || b;}
 
+/* Partial derivatives for gradients, given the operands and the function's 'result' */
+static void d_add(double a, double b, double result, double* da, double* db) {*da = 1; *db = 1;}
+static void d_sub(double a, double b, double result, double* da, double* db) {*da = 1; *db = -1;}
+static void d_mul(double a, double b, double result, double* da, double* db) {*da = b; *db = a;}
+static void d_div(double a, double b, double result, double* da, double* db) {*da = 1/b; *db = -result/b;}
+static void d_pow(double a, double b, double result, double* da, double* db) {
+    *da = b == 0 ? 0 : b*pow(a, b - 1);
+    *db = a > 0 ? result*log(a) : 0;
+}
+/* '%' (which truncates its operands), comparisons and logic are piecewise constant */
+static void d_constant(double a, double b, double result, double* da, double* db) {*da = 0; *db = 0;}
+
+/* Bounds for interval evaluation. Comparisons and logic are false for a NaN operand, '&' and '|' treat NaN as true */
+static Interval i_add(Interval a, Interval b) {return interval_add(a, b);}
+static Interval i_sub(Interval a, Interval b) {return interval_add(a, i_negate(b));}
+static Interval i_mul(Interval a, Interval b) {return interval_mul(a, b);}
+static Interval i_div(Interval a, Interval b) {return interval_div(a, b);}
+static Interval i_mod(Interval a, Interval b) {return interval_mod(a, b);}
+static Interval i_pow(Interval a, Interval b) {return interval_pow(a, b);}
+static Interval i_equal(Interval a, Interval b) {
+    bool single_value = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+    return interval_bool(a.maybe_nan || b.maybe_nan || !single_value, a.lo <= b.hi && b.lo <= a.hi);
+}
+static Interval i_greater(Interval a, Interval b) {return interval_bool(a.maybe_nan || b.maybe_nan || a.lo <= b.hi, a.hi > b.lo);}
+static Interval i_less(Interval a, Interval b) {return i_greater(b, a);}
+static Interval i_greater_equal(Interval a, Interval b) {return interval_bool(a.maybe_nan || b.maybe_nan || a.lo < b.hi, a.hi >= b.lo);}
+static Interval i_less_equal(Interval a, Interval b) {return i_greater_equal(b, a);}
+static Interval i_and(Interval a, Interval b) {
+    return interval_bool(interval_can_be_false(a) || interval_can_be_false(b), interval_can_be_true(a) && interval_can_be_true(b));
+}
+static Interval i_or(Interval a, Interval b) {
+    return interval_bool(interval_can_be_false(a) && interval_can_be_false(b), interval_can_be_true(a) || interval_can_be_true(b));
+}
+
 // Enum 'BINARY_FUNCTION_NAMES', used as an index in the 'binary_fns' array.
 enum BINARY_FUNCTION_NAMES {BFN_ADD=0, BFN_SUB, BFN_MUL, BFN_DIV, BFN_MOD,
     BFN_POW, BFN_EQUAL, BFN_GREATER, BFN_LESS, BFN_GREATER_EQUAL,
     BFN_LESS_EQUAL, BFN_AND, BFN_OR};
 static BinaryFn binary_fns[] = {
-//  function name   precedence     function pointer
-    {.name="+",    .precedence=4, .fnptr=fn_add},
-    {.name="-",    .precedence=4, .fnptr=fn_sub},
-    {.name="*",    .precedence=5, .fnptr=fn_mul},
-    {.name="/",    .precedence=5, .fnptr=fn_div},
-    {.name="%",    .precedence=5, .fnptr=fn_mod},
-    {.name="^",    .precedence=6, .fnptr=pow},
-    {.name="=",    .precedence=3, .fnptr=fn_equal},
-    {.name=">",    .precedence=3, .fnptr=fn_greater},
-    {.name="<",    .precedence=3, .fnptr=fn_less},
-    {.name=">=",   .precedence=3, .fnptr=fn_greater_equal},
-    {.name="<=",   .precedence=3, .fnptr=fn_less_equal},
-    {.name="&",    .precedence=2, .fnptr=fn_and},
-    {.name="|",    .precedence=1, .fnptr=fn_or}
+//  function name   precedence     function pointer          derivative            interval bounds
+    {.name="+",    .precedence=4, .fnptr=fn_add,           .dfnptr=d_add,      .ifnptr=i_add},
+    {.name="-",    .precedence=4, .fnptr=fn_sub,           .dfnptr=d_sub,      .ifnptr=i_sub},
+    {.name="*",    .precedence=5, .fnptr=fn_mul,           .dfnptr=d_mul,      .ifnptr=i_mul},
+    {.name="/",    .precedence=5, .fnptr=fn_div,           .dfnptr=d_div,      .ifnptr=i_div},
+    {.name="%",    .precedence=5, .fnptr=fn_mod,           .dfnptr=d_constant, .ifnptr=i_mod},
+    {.name="^",    .precedence=6, .fnptr=pow,              .dfnptr=d_pow,      .ifnptr=i_pow},
+    {.name="=",    .precedence=3, .fnptr=fn_equal,         .dfnptr=d_constant, .ifnptr=i_equal},
+    {.name=">",    .precedence=3, .fnptr=fn_greater,       .dfnptr=d_constant, .ifnptr=i_greater},
+    {.name="<",    .precedence=3, .fnptr=fn_less,          .dfnptr=d_constant, .ifnptr=i_less},
+    {.name=">=",   .precedence=3, .fnptr=fn_greater_equal, .dfnptr=d_constant, .ifnptr=i_greater_equal},
+    {.name="<=",   .precedence=3, .fnptr=fn_less_equal,    .dfnptr=d_constant, .ifnptr=i_less_equal},
+    {.name="&",    .precedence=2, .fnptr=fn_and,           .dfnptr=d_constant, .ifnptr=i_and},
+    {.name="|",    .precedence=1, .fnptr=fn_or,            .dfnptr=d_constant, .ifnptr=i_or}
+};
+
+/* N-ary functions, called as 'name(a, b, ...)'. 'fmin'/'fmax' ignore a NaN argument, unless every argument is NaN */
+static double fn_min(const double* args, uint32_t args_count) {
+    double result = args[0];
+    for (uint32_t i=1; i < args_count; i++) { result = fmin(result, args[i]); }
+    return result;
+}
+static double fn_max(const double* args, uint32_t args_count) {
+    double result = args[0];
+    for (uint32_t i=1; i < args_count; i++) { result = fmax(result, args[i]); }
+    return result;
+}
+static double fn_hypot(const double* args, uint32_t args_count) {
+    double result = fabs(args[0]);
+    for (uint32_t i=1; i < args_count; i++) { result = hypot(result, args[i]); }
+    return result;
+}
+static double fn_clamp(const double* args, uint32_t args_count) {return fmin(fmax(args[0], args[1]), args[2]);}
+static double fn_fma(const double* args, uint32_t args_count) {return fma(args[0], args[1], args[2]);}
+static double fn_if(const double* args, uint32_t args_count) {return args[0] ? args[1] : args[2];} // NaN is true, as in C.
+
+/* Partial derivatives for gradients, one per argument. Only the argument picked by min, max or clamp has any */
+static void d_select(const double* args, uint32_t args_count, double result, double* d_args) {
+    bool found = false;
+    for (uint32_t i=0; i < args_count; i++) {
+        d_args[i] = !found && args[i] == result;
+        found = found || d_args[i] != 0;
+    }
+}
+static void d_hypot(const double* args, uint32_t args_count, double result, double* d_args) {
+    for (uint32_t i=0; i < args_count; i++) { d_args[i] = result == 0 ? 0 : args[i]/result; }
+}
+static void d_fma(const double* args, uint32_t args_count, double result, double* d_args) {
+    d_args[0] = args[1];
+    d_args[1] = args[0];
+    d_args[2] = 1;
+}
+static void d_if(const double* args, uint32_t args_count, double result, double* d_args) {
+    d_args[0] = 0;
+    d_args[1] = args[0] != 0;
+    d_args[2] = args[0] == 0;
+}
+
+/* Bounds for interval evaluation. A NaN argument of min or max only matters when every argument is NaN */
+static Interval i_min(const Interval* args, uint32_t args_count) {
+    Interval output = args[0];
+    double never_nan_hi = args[0].maybe_nan ? INFINITY : args[0].hi;
+    for (uint32_t i=1; i < args_count; i++) {
+        output = (Interval){.lo=fmin(output.lo, args[i].lo), .hi=fmax(output.hi, args[i].hi), .maybe_nan=output.maybe_nan && args[i].maybe_nan};
+        never_nan_hi = args[i].maybe_nan ? never_nan_hi : fmin(never_nan_hi, args[i].hi);
+    }
+    output.hi = fmin(output.hi, never_nan_hi);
+    return output;
+}
+static Interval i_max(const Interval* args, uint32_t args_count) {
+    Interval output = args[0];
+    double never_nan_lo = args[0].maybe_nan ? -INFINITY : args[0].lo;
+    for (uint32_t i=1; i < args_count; i++) {
+        output = (Interval){.lo=fmin(output.lo, args[i].lo), .hi=fmax(output.hi, args[i].hi), .maybe_nan=output.maybe_nan && args[i].maybe_nan};
+        never_nan_lo = args[i].maybe_nan ? never_nan_lo : fmax(never_nan_lo, args[i].lo);
+    }
+    output.lo = fmax(output.lo, never_nan_lo);
+    return output;
+}
+static Interval i_hypot(const Interval* args, uint32_t args_count) {
+    /* Increasing in the magnitude of every argument */
+    Interval output = {.lo=0, .hi=0, .maybe_nan=false};
+    for (uint32_t i=0; i < args_count; i++) {
+        const double magnitude_lo = interval_has(args[i], 0) ? 0 : fmin(fabs(args[i].lo), fabs(args[i].hi));
+        const double magnitude_hi = fmax(fabs(args[i].lo), fabs(args[i].hi));
+        output = (Interval){.lo=hypot(output.lo, magnitude_lo), .hi=hypot(output.hi, magnitude_hi), .maybe_nan=output.maybe_nan || args[i].maybe_nan};
+    }
+    return interval_widen(output);
+}
+static Interval i_clamp(const Interval* args, uint32_t args_count) {
+    const Interval lower_args[2] = {args[0], args[1]};
+    const Interval upper_args[2] = {i_max(lower_args, 2), args[2]};
+    return i_min(upper_args, 2);
+}
+static Interval i_fma(const Interval* args, uint32_t args_count) {
+    /* Bilinear in 'a' and 'b', increasing in 'c', so the bounds are fused at the corners, each rounded once like 'fn_fma' */
+    if ((interval_has(args[0], 0) && interval_has_inf(args[1])) || (interval_has(args[1], 0) && interval_has_inf(args[0]))) {
+        return interval_whole(true); // 0*inf
+    }
+    const double a_corners[4] = {args[0].lo, args[0].lo, args[0].hi, args[0].hi};
+    const double b_corners[4] = {args[1].lo, args[1].hi, args[1].lo, args[1].hi};
+    Interval output = {.lo=INFINITY, .hi=-INFINITY, .maybe_nan=args[0].maybe_nan || args[1].maybe_nan || args[2].maybe_nan};
+    for (uint32_t i=0; i < 4; i++) {
+        const double corner_lo = fma(a_corners[i], b_corners[i], args[2].lo);
+        const double corner_hi = fma(a_corners[i], b_corners[i], args[2].hi);
+        if (isnan(corner_lo) || isnan(corner_hi)) {
+            return interval_whole(true); // inf-inf
+        }
+        output.lo = fmin(output.lo, corner_lo);
+        output.hi = fmax(output.hi, corner_hi);
+    }
+    return interval_widen(output);
+}
+static Interval i_if(const Interval* args, uint32_t args_count) {
+    /* The hull of every branch the condition can take */
+    if (!interval_can_be_false(args[0])) {
+        return args[1];
+    } else if (!interval_can_be_true(args[0])) {
+        return args[2];
+    }
+    return (Interval){.lo=fmin(args[1].lo, args[2].lo), .hi=fmax(args[1].hi, args[2].hi), .maybe_nan=args[1].maybe_nan || args[2].maybe_nan};
+}
+
+// Enum 'NARY_FUNCTION_NAMES', used as an index in the 'nary_fns' array.
+// 'if(condition, a, b)' only evaluates the branch it picks, see 'OP_SELECT' in 'meval.c'.
+enum NARY_FUNCTION_NAMES {NFN_MIN=0, NFN_MAX, NFN_HYPOT, NFN_CLAMP, NFN_FMA, NFN_IF};
+static NaryFn nary_fns[] = {
+//  function name    arguments count                                  function pointer   derivative          interval bounds
+    {.name="min",   .min_args_count=1, .max_args_count=CALL_MAX_ARGS_COUNT, .fnptr=fn_min,   .dfnptr=d_select,   .ifnptr=i_min},
+    {.name="max",   .min_args_count=1, .max_args_count=CALL_MAX_ARGS_COUNT, .fnptr=fn_max,   .dfnptr=d_select,   .ifnptr=i_max},
+    {.name="hypot", .min_args_count=1, .max_args_count=CALL_MAX_ARGS_COUNT, .fnptr=fn_hypot, .dfnptr=d_hypot,    .ifnptr=i_hypot},
+    {.name="clamp", .min_args_count=3, .max_args_count=3,                   .fnptr=fn_clamp, .dfnptr=d_select,   .ifnptr=i_clamp},
+    {.name="fma",   .min_args_count=3, .max_args_count=3,                   .fnptr=fn_fma,   .dfnptr=d_fma,      .ifnptr=i_fma},
+    {.name="if",    .min_args_count=3, .max_args_count=3,                   .fnptr=fn_if,    .dfnptr=d_if,       .ifnptr=i_if}
 };
 
 enum CONSTANT_NAMES {CN_PI=0, CN_E};
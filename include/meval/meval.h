@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -27,12 +28,131 @@ typedef struct {
 } MEvalVarArr;
 
 typedef struct MEvalCompiledExpr MEvalCompiledExpr;
+typedef double (*MEvalJitFn)(const double* values);
+
+typedef struct {
+    void* (*alloc_fn)(void* ctx, size_t size); // Must return memory aligned for any type, or NULL.
+    void (*free_fn)(void* ctx, void* ptr); // May be NULL, if memory is released some other way.
+    void* ctx;
+} MEvalAllocator;
+
+typedef struct {
+    double lo;
+    double hi;
+} MEvalInterval;
+
+typedef struct MEvalEvalContext MEvalEvalContext;
+typedef struct MEvalProgram MEvalProgram;
+typedef struct MEvalCompiledFile MEvalCompiledFile;
+typedef struct MEvalCache MEvalCache;
+typedef struct MEvalRegistry MEvalRegistry;
+typedef struct MEvalVarEnv MEvalVarEnv;
+#define MEVAL_VAR_ENV_NO_HANDLE UINT32_MAX
+typedef double (*MEvalUnaryCallback)(void* userdata, double a);
+typedef double (*MEvalBinaryCallback)(void* userdata, double a, double b);
+typedef double (*MEvalNaryCallback)(void* userdata, const double* args, uint32_t args_count);
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint32_t entries_count;
+    uint32_t capacity;
+} MEvalCacheStats;
+
+enum MEVAL_PHASE {MEVAL_PHASE_PARSE, MEVAL_PHASE_FOLD, MEVAL_PHASE_CODEGEN, MEVAL_PHASE_EVAL, MEVAL_PHASE_COUNT};
+typedef struct {
+    uint64_t compile_calls;
+    uint64_t eval_calls; // Scalar evaluations, one-shot, compiled, bound, cached or JIT.
+    uint64_t batch_rows;
+    uint64_t allocations_count; // Through the 'MEvalAllocator' of a compile or evaluation.
+    uint64_t bytes_allocated;
+    uint64_t tokens_count; // Produced by the lexer.
+    uint64_t var_lookups; // Variables looked up by name.
+    uint64_t max_stack_depth;
+    uint64_t phase_ns[MEVAL_PHASE_COUNT];
+} MEvalStats;
+
+typedef struct {
+    unsigned char* buffer;
+    size_t capacity;
+    size_t used;
+} MEvalArena;
 
 double meval(const char* input_string, MEvalError* error);
 double meval_var(const char* input_string, const MEvalVarArr variables, MEvalError* error);
 MEvalCompiledExpr* meval_var_compile(const char* input_string, MEvalError* output_error);
+double meval_alloc(const char* input_string, const MEvalAllocator* allocator, MEvalError* error);
+double meval_var_alloc(const char* input_string, const MEvalVarArr variables, const MEvalAllocator* allocator, MEvalError* error);
+MEvalCompiledExpr* meval_var_compile_alloc(const char* input_string, const MEvalAllocator* allocator, MEvalError* output_error);
 double meval_var_eval_cexpr(const MEvalCompiledExpr* compiled_expr, const MEvalVarArr variables, MEvalError* output_error);
+bool meval_var_bind_cexpr(MEvalCompiledExpr* compiled_expr, const MEvalVarArr variables, MEvalError* output_error);
+double meval_var_eval_bound_cexpr(const MEvalCompiledExpr* compiled_expr, const double* values, MEvalError* output_error);
+double meval_var_eval_bound_cexpr_scratch(const MEvalCompiledExpr* compiled_expr, const double* values, double* scratch, MEvalError* output_error);
+uint32_t meval_cexpr_scratch_count(const MEvalCompiledExpr* compiled_expr);
+double meval_var_grad_bound_cexpr(const MEvalCompiledExpr* compiled_expr, const double* values, double* gradient, MEvalError* output_error);
+MEvalInterval meval_var_eval_bound_cexpr_interval(const MEvalCompiledExpr* compiled_expr, const MEvalInterval* ranges, MEvalError* output_error);
+MEvalEvalContext* meval_eval_context_create(const MEvalCompiledExpr* compiled_expr, const double* values, MEvalError* output_error);
+void meval_eval_context_set(MEvalEvalContext* context, uint32_t slot, double value);
+double meval_eval_context_eval(MEvalEvalContext* context);
+void meval_eval_context_free(MEvalEvalContext** context);
+bool meval_var_eval_bound_cexpr_batch(const MEvalCompiledExpr* compiled_expr, const double* const* columns, size_t rows_count, double* output, MEvalError* output_error);
+bool meval_var_eval_bound_cexpr_batch_parallel(const MEvalCompiledExpr* compiled_expr, const double* const* columns, size_t rows_count, double* output, uint32_t threads_count, MEvalError* output_error);
+bool meval_var_jit_cexpr(MEvalCompiledExpr* compiled_expr, MEvalError* output_error);
+MEvalJitFn meval_cexpr_jit_fn(const MEvalCompiledExpr* compiled_expr);
+uint32_t meval_cexpr_var_count(const MEvalCompiledExpr* compiled_expr);
+const char* meval_cexpr_var_name(const MEvalCompiledExpr* compiled_expr, uint32_t var_index);
 
 bool meval_append_variable(MEvalVarArr *variables_array, MEvalVar new_variable);
 void meval_free_variable_arr(MEvalVarArr *variables_array);
 void meval_free_compiled_expr(MEvalCompiledExpr** compiled_expr);
+
+MEvalVarEnv* meval_var_env_create(uint32_t capacity, MEvalError* output_error);
+uint32_t meval_var_env_set(MEvalVarEnv* env, const char* name, double value, MEvalError* output_error);
+uint32_t meval_var_env_find(const MEvalVarEnv* env, const char* name);
+bool meval_var_env_get(const MEvalVarEnv* env, const char* name, double* output_value);
+void meval_var_env_set_handle(MEvalVarEnv* env, uint32_t handle, double value);
+double meval_var_env_get_handle(const MEvalVarEnv* env, uint32_t handle);
+double* meval_var_env_values(MEvalVarEnv* env);
+uint32_t meval_var_env_count(const MEvalVarEnv* env);
+const char* meval_var_env_name(const MEvalVarEnv* env, uint32_t handle);
+void meval_var_env_free(MEvalVarEnv** env);
+double meval_var_env(const char* input_string, const MEvalVarEnv* env, MEvalError* error);
+MEvalCompiledExpr* meval_var_compile_env(const char* input_string, const MEvalVarEnv* env, MEvalError* output_error);
+bool meval_var_bind_cexpr_env(MEvalCompiledExpr* compiled_expr, const MEvalVarEnv* env, MEvalError* output_error);
+double meval_var_eval_cexpr_env(const MEvalCompiledExpr* compiled_expr, const MEvalVarEnv* env, MEvalError* output_error);
+
+void meval_arena_init(MEvalArena* arena, void* buffer, size_t capacity);
+void meval_arena_reset(MEvalArena* arena);
+MEvalAllocator meval_arena_allocator(MEvalArena* arena);
+
+MEvalCache* meval_cache_create(uint32_t capacity, MEvalError* output_error);
+double meval_var_cached(MEvalCache* cache, const char* input_string, const MEvalVarArr variables, MEvalError* error);
+MEvalCacheStats meval_cache_stats(MEvalCache* cache);
+void meval_cache_clear(MEvalCache* cache);
+void meval_cache_free(MEvalCache** cache);
+
+MEvalProgram* meval_program_compile(const char* const* input_strings, uint32_t expressions_count, uint32_t* output_error_expr_index, MEvalError* output_error);
+bool meval_program_bind(MEvalProgram* program, const MEvalVarArr variables, MEvalError* output_error);
+bool meval_program_eval_bound(const MEvalProgram* program, const double* values, double* outputs, MEvalError* output_error);
+uint32_t meval_program_var_count(const MEvalProgram* program);
+const char* meval_program_var_name(const MEvalProgram* program, uint32_t var_index);
+uint32_t meval_program_node_count(const MEvalProgram* program);
+void meval_free_program(MEvalProgram** program);
+
+bool meval_cexpr_file_write(const char* path, const MEvalCompiledExpr* const* compiled_exprs, uint32_t expressions_count, MEvalError* output_error);
+MEvalCompiledFile* meval_cexpr_file_open(const char* path, MEvalError* output_error);
+uint32_t meval_cexpr_file_count(const MEvalCompiledFile* compiled_file);
+MEvalCompiledExpr* meval_cexpr_file_get(MEvalCompiledFile* compiled_file, uint32_t index);
+void meval_cexpr_file_close(MEvalCompiledFile** compiled_file);
+
+bool meval_stats_get(MEvalStats* output_stats);
+bool meval_stats_get_thread(MEvalStats* output_stats);
+void meval_stats_reset(void);
+
+MEvalRegistry* meval_registry_create(MEvalError* output_error);
+bool meval_registry_add_unary(MEvalRegistry* registry, const char* name, MEvalUnaryCallback callback, void* userdata, bool pure, MEvalError* output_error);
+bool meval_registry_add_binary(MEvalRegistry* registry, const char* name, MEvalBinaryCallback callback, void* userdata, bool pure, MEvalError* output_error);
+bool meval_registry_add_nary(MEvalRegistry* registry, const char* name, uint32_t args_count, MEvalNaryCallback callback, void* userdata, bool pure, MEvalError* output_error);
+bool meval_registry_add_constant(MEvalRegistry* registry, const char* name, double value, MEvalError* output_error);
+MEvalCompiledExpr* meval_var_compile_registry(const char* input_string, const MEvalRegistry* registry, MEvalError* output_error);
+void meval_registry_free(MEvalRegistry** registry);
@@ -6,8 +6,27 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h> // snprintf
+#include <pthread.h> // pthread_once, pthread_rwlock_t
+#include <stdatomic.h>
+#include <unistd.h> // sysconf, close
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
 #include "meval/meval.h"
 
+#if defined(MEVAL_OPT_JIT) && MEVAL_OPT_JIT == 1 && defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#if defined(MEVAL_OPT_STATS) && MEVAL_OPT_STATS == 1
+#define STATS_ENABLED 1
+#include <time.h> // clock_gettime
+#else
+#define STATS_ENABLED 0
+#endif
+
 #ifndef MEVAL_MALLOC
 #define MEVAL_MALLOC(x) malloc(x)
 #endif
@@ -18,9 +37,155 @@
 #define MEVAL_FREE(ptr) free(ptr)
 #endif
 
-enum LEX_TYPE {LT_ERROR, LT_VAR, LT_NUMBER, LT_CONST, LT_UNARY_FUNCTION, LT_BINARY_FUNCTION, LT_OPEN_BRACKET, LT_CLOSE_BRACKET};
+static void* default_alloc(void* ctx, size_t size) {
+    (void)ctx;
+    return MEVAL_MALLOC(size);
+}
+static void default_free(void* ctx, void* ptr) {
+    (void)ctx;
+    MEVAL_FREE(ptr);
+}
+static const MEvalAllocator default_allocator = {.alloc_fn=default_alloc, .free_fn=default_free, .ctx=NULL}; // Used whenever no allocator is given.
+
+/*
+ * Profiling counters, compiled in with MEVAL_OPT_STATS=1 and otherwise left out entirely.
+ *   Each thread counts into its own 'ThreadStats', so counting takes no locks or atomic
+ *   read-modify-writes. The counters are still atomics, so 'meval_stats_get( ... )' can
+ *   sum every thread's while they are being counted into. The block of an exiting thread
+ *   is folded into 'retired_stats' by the destructor of 'thread_stats_key'.
+ */
+enum STATS_COUNTER {SC_COMPILE_CALLS, SC_EVAL_CALLS, SC_BATCH_ROWS, SC_ALLOCATIONS, SC_BYTES_ALLOCATED, SC_TOKENS, SC_VAR_LOOKUPS,
+    SC_MAX_STACK_DEPTH, SC_PHASE_NS, SC_COUNT = SC_PHASE_NS + MEVAL_PHASE_COUNT};
+#if STATS_ENABLED
+typedef struct ThreadStats {
+    _Atomic uint64_t counters[SC_COUNT]; // Only written by its own thread.
+    struct ThreadStats* prev;
+    struct ThreadStats* next;
+} ThreadStats;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER; // Guards 'live_thread_stats' and 'retired_stats'.
+static ThreadStats* live_thread_stats = NULL;
+static uint64_t retired_stats[SC_COUNT] = {0};
+static pthread_once_t thread_stats_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_stats_key;
+static _Thread_local ThreadStats* thread_stats = NULL;
+
+static void add_stats_counters(uint64_t* sums, const uint64_t* counters) {
+    for (uint32_t i = 0; i < SC_COUNT; i++) {
+        if (i != SC_MAX_STACK_DEPTH) {
+            sums[i] += counters[i];
+        } else if (counters[i] > sums[i]) {
+            sums[i] = counters[i];
+        }
+    }
+}
+
+static void load_stats_counters(const ThreadStats* stats, uint64_t* output_counters) {
+    for (uint32_t i = 0; i < SC_COUNT; i++) {
+        output_counters[i] = atomic_load_explicit(&stats->counters[i], memory_order_relaxed);
+    }
+}
+
+static void retire_thread_stats(void* ptr) {
+    /* Runs in the exiting thread. A later call from its teardown counts into a new block, registered again with the key */
+    ThreadStats* stats = ptr;
+    thread_stats = NULL;
+    uint64_t counters[SC_COUNT];
+    load_stats_counters(stats, counters);
+    pthread_mutex_lock(&stats_mutex);
+    add_stats_counters(retired_stats, counters);
+    if (stats->prev != NULL) {
+        stats->prev->next = stats->next;
+    } else {
+        live_thread_stats = stats->next;
+    }
+    if (stats->next != NULL) {
+        stats->next->prev = stats->prev;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+    MEVAL_FREE(stats);
+}
+
+static void create_thread_stats_key(void) {
+    pthread_key_create(&thread_stats_key, retire_thread_stats);
+}
+
+static ThreadStats* get_thread_stats(void) {
+    /* Returns NULL if the calling thread's counters could not be allocated, which just goes uncounted */
+    if (thread_stats != NULL) {
+        return thread_stats;
+    }
+    pthread_once(&thread_stats_key_once, create_thread_stats_key);
+    ThreadStats* stats = MEVAL_MALLOC(sizeof(ThreadStats));
+    if (stats == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < SC_COUNT; i++) {
+        atomic_init(&stats->counters[i], 0);
+    }
+    if (pthread_setspecific(thread_stats_key, stats) != 0) { // Could never be retired.
+        MEVAL_FREE(stats);
+        return NULL;
+    }
+    pthread_mutex_lock(&stats_mutex);
+    stats->prev = NULL;
+    stats->next = live_thread_stats;
+    if (live_thread_stats != NULL) {
+        live_thread_stats->prev = stats;
+    }
+    live_thread_stats = stats;
+    pthread_mutex_unlock(&stats_mutex);
+    thread_stats = stats;
+    return stats;
+}
+
+static void stats_add(enum STATS_COUNTER counter, uint64_t count) {
+    ThreadStats* stats = get_thread_stats();
+    if (stats != NULL) {
+        uint64_t value = atomic_load_explicit(&stats->counters[counter], memory_order_relaxed);
+        atomic_store_explicit(&stats->counters[counter], value + count, memory_order_relaxed);
+    }
+}
+
+static void stats_max(enum STATS_COUNTER counter, uint64_t value) {
+    ThreadStats* stats = get_thread_stats();
+    if (stats != NULL && value > atomic_load_explicit(&stats->counters[counter], memory_order_relaxed)) {
+        atomic_store_explicit(&stats->counters[counter], value, memory_order_relaxed);
+    }
+}
+
+static uint64_t stats_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000000u + (uint64_t)now.tv_nsec;
+}
+
+#define STATS_ADD(counter, count) stats_add(counter, count)
+#define STATS_MAX(counter, value) stats_max(counter, value)
+#define STATS_PHASE_START(start_ns) uint64_t start_ns = stats_now_ns()
+#define STATS_PHASE_END(phase, start_ns) stats_add(SC_PHASE_NS + (phase), stats_now_ns() - (start_ns))
+#else
+#define STATS_ADD(counter, count)
+#define STATS_MAX(counter, value)
+#define STATS_PHASE_START(start_ns)
+#define STATS_PHASE_END(phase, start_ns)
+#endif
+
+static void* allocator_alloc(const MEvalAllocator* allocator, size_t size) {
+    STATS_ADD(SC_ALLOCATIONS, 1);
+    STATS_ADD(SC_BYTES_ALLOCATED, size);
+    return allocator->alloc_fn(allocator->ctx, size);
+}
+static void allocator_free(const MEvalAllocator* allocator, void* ptr) {
+    /* 'free_fn' may be NULL, for allocators that release everything at once */
+    if (ptr != NULL && allocator->free_fn != NULL) {
+        allocator->free_fn(allocator->ctx, ptr);
+    }
+}
+
+enum LEX_TYPE {LT_ERROR, LT_VAR, LT_NUMBER, LT_CONST, LT_UNARY_FUNCTION, LT_BINARY_FUNCTION, LT_OPEN_BRACKET, LT_CLOSE_BRACKET, LT_USER_FUNCTION, LT_COMMA, LT_NARY_FUNCTION};
 enum LEX_ERROR {LE_NONE, LE_UNRECOGNISED_CHAR, LE_UNRECOGNISED_IDENTIFER, LE_MANY_DECIMAL_POINTS};
-enum RPN_ERROR {RPNE_NONE, RPNE_FAILED_MEM_ALLOCATION, RPNE_MISSING_OPEN_BRACKET, RPNE_MISSING_CLOSING_BRACKET};
+enum RPN_ERROR {RPNE_NONE, RPNE_FAILED_MEM_ALLOCATION, RPNE_MISSING_OPEN_BRACKET, RPNE_MISSING_CLOSING_BRACKET, RPNE_MISPLACED_COMMA,
+    RPNE_MISSING_CALL_BRACKET /*registered function not followed by '('*/, RPNE_MISSING_ARGUMENT, RPNE_WRONG_ARGS_COUNT};
 enum EVAL_ERROR {EE_NONE, EE_FAILED_MEM_ALLOCATION, EE_NOT_ENOUGH_OPERANDS /*more functions than operators*/, EE_TOO_MANY_OPERANDS, EE_USE_OF_UNDEFINED_VAR /*function using a undefined variable*/};
 #define LEXEAME_CHAR_COUNT 64
 #define MIN(a, b) (a < b ? a : b)
@@ -32,16 +197,35 @@ enum EVAL_ERROR {EE_NONE, EE_FAILED_MEM_ALLOCATION, EE_NOT_ENOUGH_OPERANDS /*mor
 #define DBPRINT(format, ...)
 #endif
 
+typedef struct {
+    double lo; // 'lo' and 'hi' bound every value that is not NaN.
+    double hi;
+    bool maybe_nan;
+} Interval;
+
 typedef struct {
     const char* name;
     uint8_t precedence;
     double (*fnptr)(double);
+    double (*dfnptr)(double a, double result); // Derivative of 'fnptr' with respect to 'a'.
+    Interval (*ifnptr)(Interval a); // Bounds of 'fnptr' over every value of 'a'.
 } UnaryFn;
 typedef struct {
     const char* name;
     uint8_t precedence;
     double (*fnptr)(double, double);
+    void (*dfnptr)(double a, double b, double result, double* da, double* db); // Partial derivatives of 'fnptr'.
+    Interval (*ifnptr)(Interval a, Interval b); // Bounds of 'fnptr' over every pair of values of 'a' and 'b'.
 } BinaryFn;
+#define CALL_MAX_ARGS_COUNT 64 // Of n-ary and registered functions.
+typedef struct {
+    const char* name;
+    uint8_t min_args_count;
+    uint8_t max_args_count;
+    double (*fnptr)(const double* args, uint32_t args_count);
+    void (*dfnptr)(const double* args, uint32_t args_count, double result, double* d_args); // Partial derivatives of 'fnptr', one per argument.
+    Interval (*ifnptr)(const Interval* args, uint32_t args_count); // Bounds of 'fnptr' over every combination of values of 'args'.
+} NaryFn;
 typedef struct {
     const char* name;
     double value;
@@ -53,12 +237,149 @@ typedef struct {
 //  struct UnaryFn(name: str, id: enum/int, precedence: int, fnptr)
 //  struct BinaryFn(name: str, id: enum/int, precedence: int, fnptr)
 //  struct Constant(name: str, id: enum/int, value: double)
+
+/*
+ * Interval arithmetic, used by the 'ifnptr' of 'unary_fns'/'binary_fns'.
+ *   IEEE rounding is monotone, so the arithmetic done on the bounds encloses
+ *   what point evaluation computes without widening. Math library functions
+ *   make no such promise, their bounds are widened by one ulp.
+ */
+static Interval interval_whole(bool maybe_nan) {
+    return (Interval){.lo=-INFINITY, .hi=INFINITY, .maybe_nan=maybe_nan};
+}
+
+static bool interval_has(Interval a, double value) {
+    return a.lo <= value && value <= a.hi;
+}
+
+static bool interval_has_inf(Interval a) {
+    return isinf(a.lo) || isinf(a.hi);
+}
+
+static Interval interval_widen(Interval a) {
+    return (Interval){.lo=nextafter(a.lo, -INFINITY), .hi=nextafter(a.hi, INFINITY), .maybe_nan=a.maybe_nan};
+}
+
+static Interval interval_corners(double value_1, double value_2, double value_3, double value_4, bool maybe_nan) {
+    /* Smallest interval holding every value, for functions whose bounds are at the corners of their operands */
+    return (Interval){
+        .lo=fmin(fmin(value_1, value_2), fmin(value_3, value_4)),
+        .hi=fmax(fmax(value_1, value_2), fmax(value_3, value_4)),
+        .maybe_nan=maybe_nan};
+}
+
+static Interval interval_increasing(Interval a, double (*fnptr)(double)) {
+    return interval_widen((Interval){.lo=fnptr(a.lo), .hi=fnptr(a.hi), .maybe_nan=a.maybe_nan});
+}
+
+static Interval interval_decreasing(Interval a, double (*fnptr)(double)) {
+    return interval_widen((Interval){.lo=fnptr(a.hi), .hi=fnptr(a.lo), .maybe_nan=a.maybe_nan});
+}
+
+static bool interval_has_periodic(Interval a, double offset, double period) {
+    /* Whether 'a' may hold 'offset + k*period' for some integer k, erring on the side of true */
+    const double tolerance = 1e-12*(1 + fabs(a.lo) + fabs(a.hi));
+    const double point = offset + ceil((a.lo - tolerance - offset)/period)*period;
+    return point <= a.hi + tolerance;
+}
+
+static Interval interval_periodic(Interval a, double (*fnptr)(double), double max_offset, double min_offset) {
+    /* Bounds of sin or cos, reaching 1 at 'max_offset' and -1 at 'min_offset' (plus multiples of 2pi) */
+    if (interval_has_inf(a)) {
+        return (Interval){.lo=-1, .hi=1, .maybe_nan=true};
+    }
+    if (a.hi - a.lo >= 2*M_PI) {
+        return (Interval){.lo=-1, .hi=1, .maybe_nan=a.maybe_nan};
+    }
+    Interval output = interval_widen(interval_corners(fnptr(a.lo), fnptr(a.hi), fnptr(a.lo), fnptr(a.hi), a.maybe_nan));
+    if (interval_has_periodic(a, max_offset, 2*M_PI)) {
+        output.hi = 1;
+    }
+    if (interval_has_periodic(a, min_offset, 2*M_PI)) {
+        output.lo = -1;
+    }
+    output.lo = fmax(output.lo, -1);
+    output.hi = fmin(output.hi, 1);
+    return output;
+}
+
+static Interval interval_add(Interval a, Interval b) {
+    if ((a.lo == -INFINITY && b.hi == INFINITY) || (a.hi == INFINITY && b.lo == -INFINITY)) {
+        return interval_whole(true); // inf-inf
+    }
+    return (Interval){.lo=a.lo + b.lo, .hi=a.hi + b.hi, .maybe_nan=a.maybe_nan || b.maybe_nan};
+}
+
+static Interval interval_mul(Interval a, Interval b) {
+    if ((interval_has(a, 0) && interval_has_inf(b)) || (interval_has(b, 0) && interval_has_inf(a))) {
+        return interval_whole(true); // 0*inf
+    }
+    return interval_corners(a.lo*b.lo, a.lo*b.hi, a.hi*b.lo, a.hi*b.hi, a.maybe_nan || b.maybe_nan);
+}
+
+static Interval interval_div(Interval a, Interval b) {
+    if (interval_has(b, 0)) {
+        return interval_whole(a.maybe_nan || b.maybe_nan || interval_has(a, 0)); // 0/0
+    }
+    if (interval_has_inf(a) && interval_has_inf(b)) {
+        return interval_whole(true); // inf/inf
+    }
+    return interval_corners(a.lo/b.lo, a.lo/b.hi, a.hi/b.lo, a.hi/b.hi, a.maybe_nan || b.maybe_nan);
+}
+
+static Interval interval_pow(Interval a, Interval b) {
+    bool maybe_nan = a.maybe_nan || b.maybe_nan;
+    if (b.lo == b.hi && isfinite(b.lo) && b.lo == floor(b.lo)) {
+        /* An integer power is monotone on either side of 0, whatever the sign of the base */
+        const double power = b.lo;
+        if (power == 0) {
+            return (Interval){.lo=1, .hi=1, .maybe_nan=maybe_nan};
+        }
+        if (power < 0 && interval_has(a, 0)) {
+            return interval_whole(maybe_nan);
+        }
+        const double middle = interval_has(a, 0) ? pow(0, power) : pow(a.lo, power);
+        return interval_widen(interval_corners(pow(a.lo, power), pow(a.hi, power), middle, middle, maybe_nan));
+    }
+    if (a.lo < 0) {
+        return interval_whole(true); // A negative base to a fractional power.
+    }
+    /* With a non-negative base, pow is monotone in each operand */
+    return interval_widen(interval_corners(pow(a.lo, b.lo), pow(a.lo, b.hi), pow(a.hi, b.lo), pow(a.hi, b.hi), maybe_nan));
+}
+
+static Interval interval_mod(Interval a, Interval b) {
+    /* 'fn_mod' truncates both operands to size_t. Outside of size_t's range (or for a divisor of 0) its result is undefined */
+    const double size_limit = 18446744073709551616.0; // 2^64
+    if (a.maybe_nan || b.maybe_nan || a.lo < 0 || b.lo < 1 || a.hi >= size_limit || b.hi >= size_limit) {
+        return interval_whole(true);
+    }
+    if (floor(a.hi) < floor(b.lo)) {
+        return (Interval){.lo=floor(a.lo), .hi=floor(a.hi), .maybe_nan=false}; // The dividend is always smaller.
+    }
+    return (Interval){.lo=0, .hi=fmin(floor(a.hi), floor(b.hi) - 1), .maybe_nan=false};
+}
+
+static Interval interval_bool(bool can_be_false, bool can_be_true) {
+    return (Interval){.lo=can_be_false ? 0 : 1, .hi=can_be_true ? 1 : 0, .maybe_nan=false};
+}
+
+static bool interval_can_be_false(Interval a) {
+    return interval_has(a, 0);
+}
+
+static bool interval_can_be_true(Interval a) {
+    return a.maybe_nan || a.lo != 0 || a.hi != 0; // NaN is true.
+}
+
 #include "meval/iconfig.h"
 
 static size_t unary_fn_count = sizeof(unary_fns)/sizeof(UnaryFn); // Seems to be accurate enough. Although if issues occur, just update this manually.
 
 static size_t binary_fn_count = sizeof(binary_fns)/sizeof(BinaryFn); // Seems to be accurate enough. Although if issues occur, just update this manually.
 
+static size_t nary_fn_count = sizeof(nary_fns)/sizeof(NaryFn);
+
 static size_t constants_count = sizeof(constants)/sizeof(Constant); // Seems to be accurate enough. Although if issues occur, just update this manually.
 
 typedef struct {
@@ -73,6 +394,13 @@ typedef struct {
         enum BINARY_FUNCTION_NAMES binary_fn;
         enum CONSTANT_NAMES const_name;
         char var_name[LEXEAME_CHAR_COUNT];
+        uint32_t var_id; // Index into 'MEvalCompiledExpr.var_names', replaces 'var_name' once the variable table is generated.
+        uint32_t user_fn; // Index into 'MEvalRegistry.fns'.
+        struct {
+            enum NARY_FUNCTION_NAMES fn;
+            uint32_t args_count; // Set once the call's ')' is found.
+        } nary_call;
+        uint32_t call_args_count; // LT_OPEN_BRACKET following a LT_USER_FUNCTION or LT_NARY_FUNCTION, the arguments seen so far. 0 for any other bracket.
     } value;
 } LexToken;
 
@@ -82,11 +410,103 @@ typedef struct {
     uint32_t tokens_capacity;
 } LexTokenArray;
 
+#define UNARY_FN_COUNT (sizeof(unary_fns)/sizeof(UnaryFn))
+#define BINARY_FN_COUNT (sizeof(binary_fns)/sizeof(BinaryFn))
+#define NARY_FN_COUNT (sizeof(nary_fns)/sizeof(NaryFn))
+
+/*
+ * Bytecode instructions of a 'MEvalCompiledExpr', one byte each. Functions
+ *   are encoded directly in the opcode (OP_UNARY_FN + 'enum UNARY_FUNCTION_NAMES',
+ *   OP_BINARY_FN + 'enum BINARY_FUNCTION_NAMES', OP_NARY_FN + 'enum NARY_FUNCTION_NAMES'),
+ *   so only OP_NUMBER, OP_VAR, n-ary and registered functions, jumps and
+ *   OP_SELECT read anything else, each from its pool in instruction order.
+ * Jumps only go forward. Their next JUMP_OPERANDS_COUNT 'operands' are where
+ *   the jump lands, the index into 'ops', 'numbers' and 'operands'.
+ *   '&' and '|' are compiled as 'a OP_SKIP_IF_x b &', and
+ *   'if(c, a, b)' as 'c OP_JUMP_IF_FALSE a OP_JUMP b OP_SELECT'. Evaluators
+ *   that take the jumps skip the branch not taken, OP_SELECT is then only
+ *   reached after 'b' and does nothing. Evaluators that ignore the jumps
+ *   evaluate both branches, and OP_SELECT picks one as 'nary_fns[NFN_IF]'.
+ */
+enum OPCODE {OP_NUMBER /*next 'numbers'*/, OP_VAR /*next 'operands' is the var_id*/, OP_UNARY_FN,
+    OP_BINARY_FN = OP_UNARY_FN + UNARY_FN_COUNT, OP_NARY_FN = OP_BINARY_FN + BINARY_FN_COUNT /*next 'operands' is the arguments count*/,
+    OP_END = OP_NARY_FN + NARY_FN_COUNT /*always follows the last instruction*/,
+    OP_USER_UNARY_FN /*next 'operands' is the index into 'MEvalRegistry.fns'*/, OP_USER_BINARY_FN, OP_USER_NARY_FN,
+    OP_JUMP_IF_FALSE /*pops the condition*/, OP_JUMP, OP_SKIP_IF_FALSE /*'&', leaves 0 and jumps past it when 'a' is false*/,
+    OP_SKIP_IF_TRUE /*'|', leaves 1 and jumps past it when 'a' is true*/, OP_SELECT, OP_COUNT};
+#define JUMP_OPERANDS_COUNT 3
+_Static_assert(OP_COUNT <= UINT8_MAX+1, "Too many functions to be encoded as single byte opcodes");
+
 typedef struct MEvalCompiledExpr {
-    LexToken* tokens;
-    uint32_t tokens_count;
+    /* 'numbers', 'operands' and 'ops' share a single allocation, owned by 'numbers'. 'ops[ops_count]' is OP_END */
+    double* numbers; // Constant pool, read in order by OP_NUMBER.
+    uint32_t numbers_count;
+    uint32_t* operands; // Operand pool, read in order by OP_VAR.
+    uint32_t operands_count;
+    uint8_t* ops; // 'enum OPCODE' per instruction.
+    uint32_t ops_count;
+    char (*var_names)[MEVAL_VAR_NAME_MAX_LEN]; // Every distinct variable used, indexed by var_id.
+    uint32_t var_count;
+    uint32_t* var_slots; // var_id -> index into the bound schema. NULL until 'meval_var_bind_cexpr' succeeds.
+    uint32_t max_stack_depth; // Found by 'gen_stack_depth' while compiling.
+    const MEvalRegistry* registry; // Compiled against, NULL unless the bytecode calls registered functions.
+    MEvalJitFn jit_fn; // Native code for the bound expression, NULL unless 'meval_var_jit_cexpr' succeeds.
+    void* jit_code; // Executable mapping of 'jit_code_size' bytes holding 'jit_fn'.
+    size_t jit_code_size;
+    MEvalAllocator allocator; // Allocated the struct and everything it owns.
 } MEvalCompiledExpr;
 
+/*
+ * Runtime registered functions and constants. Names are resolved through the
+ *   registry's own identifier trie (holding the built in names too), into an
+ *   index that the bytecode carries, so calls cost no lookups.
+ */
+#define REGISTRY_MAX_NAMES_COUNT UINT16_MAX // Trie nodes index names with 16 bits.
+
+typedef struct {
+    char name[MEVAL_VAR_NAME_MAX_LEN];
+    uint8_t op; // OP_USER_UNARY_FN, OP_USER_BINARY_FN or OP_USER_NARY_FN.
+    uint32_t args_count;
+    union {
+        MEvalUnaryCallback unary;
+        MEvalBinaryCallback binary;
+        MEvalNaryCallback nary;
+    } fnptr;
+    void* userdata;
+    bool pure; // Only depends on its arguments, so may be folded when they are constant.
+} RegisteredFn;
+
+typedef struct {
+    char name[MEVAL_VAR_NAME_MAX_LEN];
+    double value;
+} RegisteredConstant;
+
+typedef struct IdentifierTrieNode IdentifierTrieNode;
+typedef struct MEvalRegistry {
+    RegisteredFn* fns;
+    uint32_t fns_count;
+    RegisteredConstant* constants;
+    uint32_t constants_count;
+    IdentifierTrieNode* trie; // Starts as the built in names, each added name is inserted into it.
+    uint32_t trie_nodes_count;
+    uint32_t trie_capacity;
+} MEvalRegistry;
+
+static double call_registered_fn(const RegisteredFn* fn, const double* args) {
+    if (fn->op == OP_USER_UNARY_FN) {
+        return fn->fnptr.unary(fn->userdata, args[0]);
+    } else if (fn->op == OP_USER_BINARY_FN) {
+        return fn->fnptr.binary(fn->userdata, args[0], args[1]);
+    }
+    return fn->fnptr.nary(fn->userdata, args, fn->args_count);
+}
+
+#define EVAL_LOCAL_SCRATCH_COUNT 64 // Evaluation scratch (variable values + number stack) kept on the C stack before falling back to the heap.
+#define EVAL_BATCH_BLOCK_LEN 256 // Rows evaluated together by each instruction in batch evaluation.
+#define EVAL_BATCH_MAX_JUMPING_IFS 64 // Nested deeper, an 'if' in batch evaluation always evaluates both branches.
+#define EVAL_PARALLEL_CHUNK_LEN (16*EVAL_BATCH_BLOCK_LEN) // Rows claimed at a time by a parallel batch worker.
+#define CACHE_LINE_LEN 64 // Bytes, for keeping data written by different threads apart.
+
 const char* get_rpn_error_str(enum RPN_ERROR error) {
     switch (error) {
         case RPNE_NONE:
@@ -97,6 +517,14 @@ const char* get_rpn_error_str(enum RPN_ERROR error) {
             return "Missing Open Bracket";
         case RPNE_MISSING_CLOSING_BRACKET:
             return "Missing Closing Bracket";
+        case RPNE_MISPLACED_COMMA:
+            return "Comma Outside Of A Function Call";
+        case RPNE_MISSING_CALL_BRACKET:
+            return "Missing Function Call Bracket";
+        case RPNE_MISSING_ARGUMENT:
+            return "Missing Function Argument";
+        case RPNE_WRONG_ARGS_COUNT:
+            return "Wrong Number Of Function Arguments";
         default:
             return "Unknown RPN_ERROR";
     };
@@ -119,6 +547,13 @@ const char* get_eval_error_str(enum EVAL_ERROR error) {
     };
 }
 
+static void set_error(MEvalError* output_error, enum MEVAL_ERROR type, uint32_t char_index, const char* message) {
+    output_error->type = type;
+    output_error->char_index = char_index;
+    strncpy(output_error->message, message, MEVAL_ERROR_STRING_LEN);
+    output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
+}
+
 // debug printing
 static void print_token_value(LexToken token) {
     if (token.type == LT_ERROR) {
@@ -137,6 +572,12 @@ static void print_token_value(LexToken token) {
         DBPRINT("value=('(')");
     } else if (token.type == LT_CLOSE_BRACKET) {
         DBPRINT("value=(')')");
+    } else if (token.type == LT_USER_FUNCTION) {
+        DBPRINT("value=(user_function=%u)", token.value.user_fn);
+    } else if (token.type == LT_COMMA) {
+        DBPRINT("value=(',')");
+    } else if (token.type == LT_NARY_FUNCTION) {
+        DBPRINT("value=(nary_function=%s, args_count=%u)", nary_fns[token.value.nary_call.fn].name, token.value.nary_call.args_count);
     } else {
         DBPRINT("value=(UNKNOWN)");
     }
@@ -147,22 +588,6 @@ static void print_token(LexToken token) {
     DBPRINT("\n");
 }
 
-static bool add_token(LexToken** token_array_ptr, uint32_t* token_array_element_count, uint32_t* token_array_allocated_element_count, LexToken new_token) {
-    /* Append the token 'new_token' to the end of the dynamic array '*token_array_ptr' */
-    if (*token_array_element_count +1 >= *token_array_allocated_element_count) {
-        uint32_t new_allocated_count = *token_array_allocated_element_count*1.5;
-        LexToken* tmp = MEVAL_REALLOCARRAY(*token_array_ptr, new_allocated_count, sizeof(LexToken));
-        if (tmp == NULL) {
-            return false;
-        }
-        *token_array_allocated_element_count = new_allocated_count;
-        *token_array_ptr = tmp;
-    }
-    (*token_array_ptr)[*token_array_element_count] = new_token;
-    (*token_array_element_count)++;
-    return true;
-}
-
 static bool add_token_to_arr(LexTokenArray* array, LexToken new_token) {
     /* Append the token 'new_token' to the end of the dynamic array '*token_array_ptr' */
     if (array->tokens_count +1 >= array->tokens_capacity) {
@@ -190,32 +615,224 @@ static bool free_tokens_arr(LexTokenArray* array) {
     return true;
 }
 
-static bool match_and_add_char(const char input, const char expected_char, enum LEX_TYPE token_type, uint32_t char_index, LexToken** token_array, uint32_t* tokens_count, uint32_t* tokens_capacity, bool* token_allocation_error) {
+/*
+ * Identifier lookup trie over the names in 'unary_fns', 'binary_fns' and
+ *   'constants'. Each node is a prefix of at least one name, and holds the
+ *   result the lexer gives an identifier chopped down to that prefix, so the
+ *   longest match is found in one pass over the identifier.
+ * Built once, on first use, then only ever read. Each registry builds its own
+ *   copy, and inserts its names into it as they are added.
+ */
+typedef struct IdentifierTrieNode {
+    char c;
+    uint16_t first_child; // 0 when there are no children, the root is never a child.
+    uint16_t next_sibling; // 0 when it is the last child.
+    enum LEX_TYPE type; // LT_UNARY_FUNCTION, LT_BINARY_FUNCTION, LT_NARY_FUNCTION, LT_CONST, or for registry names LT_USER_FUNCTION and LT_NUMBER.
+    uint16_t fn_index; // 'enum UNARY_FUNCTION_NAMES', 'enum BINARY_FUNCTION_NAMES', 'enum NARY_FUNCTION_NAMES', 'enum CONSTANT_NAMES', or an index into 'MEvalRegistry.fns'/'constants', depending on 'type'.
+    uint32_t found_count; // 1 when the prefix identifies a single name, more when ambiguous.
+    bool is_full_name; // The prefix is a whole name, which wins over the longer names it is a prefix of.
+} IdentifierTrieNode;
+
+static IdentifierTrieNode* identifier_trie = NULL; // NULL if building failed.
+static pthread_once_t identifier_trie_once = PTHREAD_ONCE_INIT;
+
+static uint16_t identifier_trie_child(const IdentifierTrieNode* trie, uint16_t node, char c) {
+    /* Returns 0 if 'node' has no child for 'c' */
+    for (uint16_t child = trie[node].first_child; child != 0; child = trie[child].next_sibling) {
+        if (trie[child].c == c) {
+            return child;
+        }
+    }
+    return 0;
+}
+
+static void gen_identifier_match(const char* prefix, uint32_t prefix_char_count, IdentifierTrieNode* node) {
     /*
-     * Returns true on successful match, else false.
-     *  'token_allocation_error' should be initalized to false, before execution.
+     * Matches 'prefix' against the tables in lexing order, the last matching
+     *   name wins. A full name match counts as found once, any other (partial)
+     *   match adds to the count making the prefix ambiguous, unless a full name
+     *   was already matched, so a longer name never hides a name it extends.
      */
-    if (input == expected_char) {
-        LexToken token = {0};
-        token.char_index = char_index;
-        token.type = token_type;
-        token.error_type = LE_NONE;
-        bool success = add_token(token_array, tokens_count, tokens_capacity, token);
-        if (!success) {
-            *token_allocation_error = true;
+    const bool allow_ambiguous_matching = false;
+    uint32_t found_count = 0;
+    bool found_full_name = false;
+    for (uint32_t i=0; i < unary_fn_count; i++) {
+        if (strncmp(unary_fns[i].name, prefix, prefix_char_count) == 0) {
+            if (strlen(unary_fns[i].name) == prefix_char_count || allow_ambiguous_matching) {
+                node->type = LT_UNARY_FUNCTION;
+                node->fn_index = i;
+                found_count = 1;
+                found_full_name = true;
+                break;
+            }
+            if (!found_full_name) {
+                node->type = LT_UNARY_FUNCTION;
+                node->fn_index = i;
+                found_count++;
+            }
         }
-        return true;
     }
-    return false;
+    for (uint32_t i=0; i < binary_fn_count; i++) {
+        if (strncmp(binary_fns[i].name, prefix, prefix_char_count) == 0) {
+            if (strlen(binary_fns[i].name) == prefix_char_count || allow_ambiguous_matching) {
+                node->type = LT_BINARY_FUNCTION;
+                node->fn_index = i;
+                found_count = 1;
+                found_full_name = true;
+                break;
+            }
+            if (!found_full_name) {
+                node->type = LT_BINARY_FUNCTION;
+                node->fn_index = i;
+                found_count++;
+            }
+        }
+    }
+    for (uint32_t i=0; i < nary_fn_count; i++) {
+        if (strncmp(nary_fns[i].name, prefix, prefix_char_count) == 0) {
+            if (strlen(nary_fns[i].name) == prefix_char_count || allow_ambiguous_matching) {
+                node->type = LT_NARY_FUNCTION;
+                node->fn_index = i;
+                found_count = 1;
+                found_full_name = true;
+                break;
+            }
+            if (!found_full_name) {
+                node->type = LT_NARY_FUNCTION;
+                node->fn_index = i;
+                found_count++;
+            }
+        }
+    }
+    for (uint32_t i=0; i < constants_count; i++) {
+        if (strncmp(constants[i].name, prefix, prefix_char_count) == 0) {
+            if (strlen(constants[i].name) == prefix_char_count || allow_ambiguous_matching) {
+                node->type = LT_CONST;
+                node->fn_index = i;
+                found_count = 1;
+                found_full_name = true;
+                break;
+            }
+            if (!found_full_name) {
+                node->type = LT_CONST;
+                node->fn_index = i;
+                found_count++;
+            }
+        }
+    }
+    node->found_count = found_count;
+    node->is_full_name = found_full_name;
+}
+
+static bool add_identifier_to_trie(IdentifierTrieNode* trie, uint32_t* nodes_count, const char* name) {
+    uint16_t node = 0;
+    for (uint32_t char_index = 0; name[char_index] != '\0'; char_index++) {
+        uint16_t child = identifier_trie_child(trie, node, name[char_index]);
+        if (child == 0) {
+            if (*nodes_count > UINT16_MAX) {
+                return false;
+            }
+            child = (*nodes_count)++;
+            trie[child] = (IdentifierTrieNode){.c=name[char_index], .first_child=0, .next_sibling=trie[node].first_child};
+            gen_identifier_match(name, char_index+1, &trie[child]);
+            trie[node].first_child = child;
+        }
+        node = child;
+    }
+    return true;
+}
+
+static IdentifierTrieNode* gen_identifier_trie(uint32_t* output_nodes_count) {
+    /* Builds the trie of every built in name, '*output_nodes_count' (may be NULL) is set to its nodes count. Returns NULL on failure */
+    uint32_t max_nodes_count = 1;
+    for (uint32_t i=0; i < unary_fn_count; i++) { max_nodes_count += strlen(unary_fns[i].name); }
+    for (uint32_t i=0; i < binary_fn_count; i++) { max_nodes_count += strlen(binary_fns[i].name); }
+    for (uint32_t i=0; i < nary_fn_count; i++) { max_nodes_count += strlen(nary_fns[i].name); }
+    for (uint32_t i=0; i < constants_count; i++) { max_nodes_count += strlen(constants[i].name); }
+    IdentifierTrieNode* trie = MEVAL_MALLOC(max_nodes_count*sizeof(IdentifierTrieNode));
+    if (trie == NULL) {
+        return NULL;
+    }
+    trie[0] = (IdentifierTrieNode){0};
+    uint32_t nodes_count = 1;
+    bool success = true;
+    for (uint32_t i=0; i < unary_fn_count && success; i++) { success = add_identifier_to_trie(trie, &nodes_count, unary_fns[i].name); }
+    for (uint32_t i=0; i < binary_fn_count && success; i++) { success = add_identifier_to_trie(trie, &nodes_count, binary_fns[i].name); }
+    for (uint32_t i=0; i < nary_fn_count && success; i++) { success = add_identifier_to_trie(trie, &nodes_count, nary_fns[i].name); }
+    for (uint32_t i=0; i < constants_count && success; i++) { success = add_identifier_to_trie(trie, &nodes_count, constants[i].name); }
+    if (!success) {
+        MEVAL_FREE(trie);
+        return NULL;
+    }
+    DBPRINT("db: identifier trie built with %u nodes\n", nodes_count);
+    if (output_nodes_count != NULL) {
+        *output_nodes_count = nodes_count;
+    }
+    return trie;
+}
+
+static void build_identifier_trie(void) {
+    /* Only called through 'pthread_once'. Never freed, lives as long as the tables it indexes */
+    identifier_trie = gen_identifier_trie(NULL);
+}
+
+/*
+ * Variable environments. Names and values are kept in separate arrays, indexed
+ *   by handle (the order the variables were added in), so the values can be
+ *   passed straight to the bound evaluation functions. Names are found through
+ *   an open addressing table, which is kept at most half full.
+ */
+typedef struct MEvalVarEnv {
+    char (*names)[MEVAL_VAR_NAME_MAX_LEN];
+    double* values;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* index; // Handle + 1, 0 for an empty slot.
+    uint32_t index_mask;
+} MEvalVarEnv;
+
+static uint64_t hash_var_name(const char* name, uint32_t char_count) {
+    /* FNV-1a, as for the cache keys */
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint32_t i=0; i < char_count; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 1099511628211ULL;
+    }
+    return hash ^ (hash >> 32);
+}
+
+static uint32_t find_env_var(const MEvalVarEnv* env, const char* name, uint32_t char_count) {
+    /* Returns the handle of the variable named by the 'char_count' chars of 'name' (need not be terminated), or MEVAL_VAR_ENV_NO_HANDLE */
+    STATS_ADD(SC_VAR_LOOKUPS, 1);
+    if (env->index == NULL || char_count >= MEVAL_VAR_NAME_MAX_LEN) {
+        return MEVAL_VAR_ENV_NO_HANDLE;
+    }
+    uint32_t table_index = hash_var_name(name, char_count) & env->index_mask;
+    while (env->index[table_index] != 0) {
+        uint32_t handle = env->index[table_index] - 1;
+        if (strncmp(env->names[handle], name, char_count) == 0 && env->names[handle][char_count] == '\0') {
+            return handle;
+        }
+        table_index = (table_index + 1) & env->index_mask;
+    }
+    return MEVAL_VAR_ENV_NO_HANDLE;
 }
 
-static void gen_lex_tokens(const char* input_string, uint32_t input_string_char_count, bool allow_variables, const MEvalVarArr expected_variables, LexToken** output_lex_tokens, uint32_t* output_lex_tokens_count, bool* error_occured) {
+typedef struct {
+    const char* input_string;
+    uint32_t input_string_char_count;
+    uint32_t char_index; // Next char to be lexed.
+    bool allow_variables;
+    MEvalVarArr expected_variables;
+    const MEvalVarEnv* expected_env; // May be NULL, otherwise used instead of 'expected_variables'.
+    const IdentifierTrieNode* trie;
+    const MEvalRegistry* registry; // May be NULL, otherwise 'trie' is the registry's own.
+} LexState;
+
+static bool lex_next_token(LexState* state, LexToken* output_token, bool* error_occured) {
     /*
-     * Input: input_string, input_string_char_count.
-     * Output: output_lex_tokens, output_lex_tokens_count, error_occured.
+     * Lexes the next token of 'state->input_string' into 'output_token'.
+     *   Returns false once the input is exhausted.
      * Note: error_occured does not get set to false. That is the job of the caller.
-     *       output_lex_tokens and output_lex_tokens_count WILL get overridden,
-     *         these should not contain any important information.
      *       'expected_variables' maybe empty, if there are no expected variables. 
      *       When 'expected_variables' is empty, every unrecognised or
      *         ambigious function is assumed to be a variable.
@@ -224,211 +841,167 @@ static void gen_lex_tokens(const char* input_string, uint32_t input_string_char_
      *         partially named functions) are treated as variables.
      *       The values for each variable in 'expected_variables' are ignored.
      */
-    *output_lex_tokens = 0;
-    *output_lex_tokens = NULL;
-    if (input_string_char_count == 0 || input_string == NULL) {
-        return;
+    const char* input_string = state->input_string;
+    uint32_t char_index = state->char_index;
+    while (char_index < state->input_string_char_count && isspace(input_string[char_index])) {
+        char_index++;
     }
-    uint32_t output_lex_tokens_allocated_count = 4;
-    *output_lex_tokens = MEVAL_MALLOC(sizeof(LexToken)*output_lex_tokens_allocated_count);
-    bool token_handle_error_occured = false;
-    for (uint32_t char_index = 0; char_index < input_string_char_count; char_index++) {
-        if (isspace(input_string[char_index])) { continue; }
-        if (match_and_add_char(input_string[char_index], '(', LT_OPEN_BRACKET, char_index, output_lex_tokens, output_lex_tokens_count, &output_lex_tokens_allocated_count, &token_handle_error_occured)) {
-        if (token_handle_error_occured) {
-            MEVAL_FREE(*output_lex_tokens);
-            *output_lex_tokens = NULL;
-            *error_occured = true;
-            return;
+    if (char_index >= state->input_string_char_count) {
+        state->char_index = char_index;
+        return false;
+    }
+    LexToken token = {0};
+    if (input_string[char_index] == '(' || input_string[char_index] == ')') {
+        token.char_index = char_index;
+        token.type = input_string[char_index] == '(' ? LT_OPEN_BRACKET : LT_CLOSE_BRACKET;
+        token.error_type = LE_NONE;
+    } else if (input_string[char_index] == ',') {
+        token.char_index = char_index;
+        token.type = LT_COMMA;
+        token.error_type = LE_NONE;
+    } else if (isdigit(input_string[char_index]) || input_string[char_index] == '.') {
+        token.type = LT_NUMBER;
+        token.error_type = LE_NONE;
+        token.char_index = char_index;
+        const char* start_char = &input_string[char_index];
+        uint32_t char_count = 1;
+        uint8_t decimal_count = 0;
+        if (input_string[char_index] == '.') {
+            decimal_count++;
         }
-        } else if (match_and_add_char(input_string[char_index], ')', LT_CLOSE_BRACKET, char_index, output_lex_tokens, output_lex_tokens_count, &output_lex_tokens_allocated_count, &token_handle_error_occured)) {
-            if (token_handle_error_occured) {
-                MEVAL_FREE(*output_lex_tokens);
-                *output_lex_tokens = NULL;
-                *error_occured = true;
-                return;
-            }
-        } else if (isdigit(input_string[char_index]) || input_string[char_index] == '.') {
-            LexToken token = {0};
-            token.type = LT_NUMBER;
-            token.error_type = LE_NONE;
-            token.char_index = char_index;
-            const char* start_char = &input_string[char_index];
-            uint32_t char_count = 1;
-            uint8_t decimal_count = 0;
-            if (input_string[char_index] == '.') {
+        for (; char_index < state->input_string_char_count; char_index++) {
+            if (isdigit(input_string[char_index])) {
+               char_count++;
+            } else if (input_string[char_index] == '.') {
                 decimal_count++;
-            }
-            for (; char_index < input_string_char_count; char_index++) {
-                if (isdigit(input_string[char_index])) {
-                   char_count++;
-                } else if (input_string[char_index] == '.') {
-                    decimal_count++;
-                    if (decimal_count > 1) {
-                        token.type = LT_ERROR;
-                        token.error_type = LE_MANY_DECIMAL_POINTS;
-                        snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Too many '.' in number", char_index);
-                    }
-                } else {
-                    char_index--;
-                    break;
+                if (decimal_count > 1) {
+                    token.type = LT_ERROR;
+                    token.error_type = LE_MANY_DECIMAL_POINTS;
+                    snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Too many '.' in number", char_index);
                 }
+            } else {
+                char_index--;
+                break;
             }
-            if (token.type != LT_ERROR) {
-                char token_buffer[LEXEAME_CHAR_COUNT] = {0};
-                strncpy(token_buffer, start_char, MIN(char_count, LEXEAME_CHAR_COUNT));
-                token.value.number = atof(token_buffer);
-            }
-            bool success = add_token(output_lex_tokens, output_lex_tokens_count, &output_lex_tokens_allocated_count, token);
-            if (!success) {
-                MEVAL_FREE(*output_lex_tokens);
-                *output_lex_tokens = NULL;
-                *error_occured = true;
-                return;
-            }
-            DBPRINT("Added new token: ");
-            print_token(token);
-        } else if (isalpha(input_string[char_index]) || ispunct(input_string[char_index])) {
-            // Add support for variables, (or have a separate lex function that adds support for variabled)
-            DBPRINT("Potential identifer...\n");
-            bool is_punct = ispunct(input_string[char_index]);
-            LexToken token = {0};
-            token.type = LT_ERROR;
-            token.error_type = LE_UNRECOGNISED_IDENTIFER;
-            snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Unknown function or constant", char_index);
-            token.char_index = char_index;
-            const char* start_char = &input_string[char_index];
-            size_t start_char_index = char_index;
-            uint32_t char_count = 1;
-            bool break_early = false;
-            for (char_index++; char_index < input_string_char_count; char_index++) {
-                if (input_string[char_index] == '(' || input_string[char_index] == ')') {
-                    break_early = true;
-                    break;
-                }
-                if ((isalpha(input_string[char_index]) && !is_punct) || (ispunct(input_string[char_index]) && is_punct)) {
-                    char_count++;
-                } else {
-                    break_early = true;
-                    break;
-                }
+        }
+        if (token.type != LT_ERROR) {
+            char token_buffer[LEXEAME_CHAR_COUNT] = {0};
+            strncpy(token_buffer, start_char, MIN(char_count, LEXEAME_CHAR_COUNT));
+            token.value.number = atof(token_buffer);
+        }
+    } else if (isalpha(input_string[char_index]) || ispunct(input_string[char_index])) {
+        // Add support for variables, (or have a separate lex function that adds support for variabled)
+        DBPRINT("Potential identifer...\n");
+        bool is_punct = ispunct(input_string[char_index]);
+        token.type = LT_ERROR;
+        token.error_type = LE_UNRECOGNISED_IDENTIFER;
+        snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Unknown function or constant", char_index);
+        token.char_index = char_index;
+        const char* start_char = &input_string[char_index];
+        size_t start_char_index = char_index;
+        uint32_t char_count = 1;
+        bool break_early = false;
+        // Walk the trie alongside the identifier, remembering the longest prefix that is (part of) a name.
+        uint16_t trie_node = identifier_trie_child(state->trie, 0, input_string[char_index]);
+        uint16_t matched_node = trie_node;
+        uint32_t matched_char_count = trie_node == 0 ? 0 : 1;
+        for (char_index++; char_index < state->input_string_char_count; char_index++) {
+            if (input_string[char_index] == '(' || input_string[char_index] == ')' || input_string[char_index] == ',') {
+                break_early = true;
+                break;
             }
-            bool needs_chopping = true;
-            uint32_t chopped_char_count = char_count+1;
-            uint32_t found_count = 0;
-            // TODO: See previous token, if non-existent or a function, then the current function can only be a unary function, therefore ignore binary function checks.
-            //   This implements binary-unary function overloading. Also removes evalution error EE_NOT_ENOUGH_OPERANDS (As a binary function can no longer be placed in a unary function location)
-            const bool allow_ambiguous_matching = false;
-            while (needs_chopping && chopped_char_count > 1) {
-                chopped_char_count--;
-                for (uint32_t i=0; i < unary_fn_count; i++) {
-                    if (strncmp(unary_fns[i].name, start_char, chopped_char_count) == 0) {
-                        token.type = LT_UNARY_FUNCTION;
-                        token.value.unary_fn = (enum UNARY_FUNCTION_NAMES)i;
-                        token.error_type = LE_NONE;
-                        needs_chopping = false;
-                        //break;
-                        if (strlen(unary_fns[i].name) == chopped_char_count || allow_ambiguous_matching) {
-                            found_count = 1;
-                            break;
-                        }
-                        found_count++;
-                    }
-                }
-                for (uint32_t i=0; i < binary_fn_count; i++) {
-                    if (strncmp(binary_fns[i].name, start_char, chopped_char_count) == 0) {
-                        token.type = LT_BINARY_FUNCTION;
-                        token.value.binary_fn = (enum BINARY_FUNCTION_NAMES)i;
-                        token.error_type = LE_NONE;
-                        needs_chopping = false;
-                        //break;
-                        if (strlen(binary_fns[i].name) == chopped_char_count || allow_ambiguous_matching) {
-                            found_count = 1;
-                            break;
-                        }
-                        found_count++;
-                    }
-                }
-                for (uint32_t i=0; i < constants_count; i++) {
-                    if (strncmp(constants[i].name, start_char, chopped_char_count) == 0) {
-                        token.type = LT_CONST;
-                        token.value.const_name = (enum CONSTANT_NAMES)i;
-                        token.error_type = LE_NONE;
-                        needs_chopping = false;
-                        //break;
-                        if (strlen(constants[i].name) == chopped_char_count || allow_ambiguous_matching) {
-                            found_count = 1;
-                            break;
-                        }
-                        found_count++;
-                    }
-                }
-                if (chopped_char_count == char_count) {
-                    for (uint32_t i=0; i < expected_variables.elements_count; i++) {
-                        if (strncmp(expected_variables.arr_ptr[i].name, start_char, chopped_char_count) == 0) {
-                            DBPRINT("Actually matched with a variable in the embedded loop\n");
-                            token.type = LT_VAR;
-                            snprintf(token.value.var_name, MIN(MEVAL_VAR_NAME_MAX_LEN, chopped_char_count+1), "%s", start_char);
-                            DBPRINT("  Variable matched %s\n", token.value.var_name);
-                            token.error_type = LE_NONE;
-                            needs_chopping = false;
-                            found_count = 0;
-                            break;
-                        }
+            if ((isalpha(input_string[char_index]) && !is_punct) || (ispunct(input_string[char_index]) && is_punct)) {
+                char_count++;
+                if (trie_node != 0) {
+                    trie_node = identifier_trie_child(state->trie, trie_node, input_string[char_index]);
+                    if (trie_node != 0) {
+                        matched_node = trie_node;
+                        matched_char_count = char_count;
                     }
                 }
+            } else {
+                break_early = true;
+                break;
             }
-            if ((found_count != 1 && allow_variables && expected_variables.elements_count == 0)
-                    || (found_count == 0 && allow_variables && expected_variables.elements_count > 0)) { // If identifier not found, or is ambigious assume it is a variable.
-                token.type = LT_VAR;
-                token.error_type = LE_NONE;
-                snprintf(token.value.var_name, MIN(MEVAL_VAR_NAME_MAX_LEN, char_count+1), "%s", start_char);
-                DBPRINT("db: Found var with name '%s', at %ld, char_len: %d within expression\n", token.value.var_name, start_char_index, char_count);
-            } else if (found_count != 1) { // found_count == 0, iden not found (does not even match partially). found_count > 1, iden is ambiguous
-                DBPRINT("found_count: %d\n", found_count);
-                token.type = LT_ERROR;
-                token.error_type = LE_UNRECOGNISED_IDENTIFER;
-                snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Unrecognised or ambiguous identifier", token.char_index);
-            }
-            if (!needs_chopping) {
-                char_index -= char_count - chopped_char_count;
-            }
-            bool success = add_token(output_lex_tokens, output_lex_tokens_count, &output_lex_tokens_allocated_count, token);
-            if (!success) {
-                MEVAL_FREE(*output_lex_tokens);
-                *output_lex_tokens = NULL;
-                *error_occured = true;
-                return;
+        }
+        bool needs_chopping = true;
+        uint32_t chopped_char_count = char_count;
+        uint32_t found_count = 0;
+        // TODO: See previous token, if non-existent or a function, then the current function can only be a unary function, therefore ignore binary function checks.
+        //   This implements binary-unary function overloading. Also removes evalution error EE_NOT_ENOUGH_OPERANDS (As a binary function can no longer be placed in a unary function location)
+        bool var_matched = false;
+        uint32_t expected_variables_count = state->expected_variables.elements_count;
+        if (state->expected_env != NULL) {
+            expected_variables_count = state->expected_env->count;
+            var_matched = find_env_var(state->expected_env, start_char, char_count) != MEVAL_VAR_ENV_NO_HANDLE;
+        }
+        for (uint32_t i=0; i < state->expected_variables.elements_count && state->expected_env == NULL; i++) { // Only the whole identifier can be an expected variable, and it wins over any function.
+            if (strncmp(state->expected_variables.arr_ptr[i].name, start_char, char_count) == 0) {
+                DBPRINT("Actually matched with a variable\n");
+                var_matched = true;
+                break;
             }
-            if (break_early) { char_index--; }
-            if (token.type == LT_ERROR) {
-                *error_occured = true;
+        }
+        if (var_matched) {
+            token.type = LT_VAR;
+            memcpy(token.value.var_name, start_char, MIN(MEVAL_VAR_NAME_MAX_LEN-1, char_count)); // Not snprintf, which would go over the rest of the input.
+            token.value.var_name[MIN(MEVAL_VAR_NAME_MAX_LEN-1, char_count)] = '\0';
+            DBPRINT("  Variable matched %s\n", token.value.var_name);
+            token.error_type = LE_NONE;
+            needs_chopping = false;
+        } else if (matched_char_count > 0) {
+            const IdentifierTrieNode* node = &state->trie[matched_node];
+            token.type = node->type;
+            if (node->type == LT_UNARY_FUNCTION) {
+                token.value.unary_fn = (enum UNARY_FUNCTION_NAMES)node->fn_index;
+            } else if (node->type == LT_BINARY_FUNCTION) {
+                token.value.binary_fn = (enum BINARY_FUNCTION_NAMES)node->fn_index;
+            } else if (node->type == LT_NARY_FUNCTION) {
+                token.value.nary_call.fn = (enum NARY_FUNCTION_NAMES)node->fn_index;
+            } else if (node->type == LT_USER_FUNCTION) {
+                token.value.user_fn = node->fn_index;
+            } else if (node->type == LT_NUMBER) { // Registered constants are substituted while lexing.
+                token.value.number = state->registry->constants[node->fn_index].value;
+            } else {
+                token.value.const_name = (enum CONSTANT_NAMES)node->fn_index;
             }
-            DBPRINT("Added new token: ");
-            print_token(token);
-        } else {
-            LexToken token = {0};
-            token.char_index = char_index;
+            token.error_type = LE_NONE;
+            needs_chopping = false;
+            found_count = node->found_count;
+            chopped_char_count = matched_char_count;
+        }
+        if ((found_count != 1 && state->allow_variables && expected_variables_count == 0)
+                || (found_count == 0 && state->allow_variables && expected_variables_count > 0)) { // If identifier not found, or is ambigious assume it is a variable.
+            token.type = LT_VAR;
+            token.error_type = LE_NONE;
+            memcpy(token.value.var_name, start_char, MIN(MEVAL_VAR_NAME_MAX_LEN-1, char_count));
+            token.value.var_name[MIN(MEVAL_VAR_NAME_MAX_LEN-1, char_count)] = '\0';
+            DBPRINT("db: Found var with name '%s', at %ld, char_len: %d within expression\n", token.value.var_name, start_char_index, char_count);
+        } else if (found_count != 1) { // found_count == 0, iden not found (does not even match partially). found_count > 1, iden is ambiguous
+            DBPRINT("found_count: %d\n", found_count);
             token.type = LT_ERROR;
-            token.error_type = LE_UNRECOGNISED_CHAR;
-            snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Unknown char", char_index);
+            token.error_type = LE_UNRECOGNISED_IDENTIFER;
+            snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Unrecognised or ambiguous identifier", token.char_index);
+        }
+        if (!needs_chopping) {
+            char_index -= char_count - chopped_char_count;
+        }
+        if (break_early) { char_index--; }
+        if (token.type == LT_ERROR) {
             *error_occured = true;
-            bool success = add_token(output_lex_tokens, output_lex_tokens_count, &output_lex_tokens_allocated_count, token);
-            if (!success) {
-                MEVAL_FREE(*output_lex_tokens);
-                *output_lex_tokens = NULL;
-                *error_occured = true;
-                return;
-            }
-            DBPRINT("Added new token: ");
-            print_token(token);
         }
-    }
-    if (*output_lex_tokens_count == 0) {
-        MEVAL_FREE(*output_lex_tokens);
-        *output_lex_tokens = NULL;
+    } else {
+        token.char_index = char_index;
+        token.type = LT_ERROR;
+        token.error_type = LE_UNRECOGNISED_CHAR;
+        snprintf(token.value.error_str, LEXEAME_CHAR_COUNT, "[%u] Unknown char", char_index);
         *error_occured = true;
     }
+    state->char_index = char_index+1;
+    *output_token = token;
+    DBPRINT("Lexed new token: ");
+    print_token(token);
+    return true;
 }
 
 static uint8_t get_fn_precedence(const LexToken* token_ptr) {
@@ -436,452 +1009,3822 @@ static uint8_t get_fn_precedence(const LexToken* token_ptr) {
         return unary_fns[token_ptr->value.unary_fn].precedence;
     } else if (token_ptr->type == LT_BINARY_FUNCTION) {
         return binary_fns[token_ptr->value.binary_fn].precedence;
+    } else if (token_ptr->type == LT_USER_FUNCTION || token_ptr->type == LT_NARY_FUNCTION) {
+        return 7; // Binds like the built in unary functions.
     }
     return 0;
 }
 
-static void gen_reverse_polish_notation(const LexToken* input_lex_tokens, const uint32_t lex_token_count, bool allow_variables, LexToken** output_rpn_tokens, uint32_t *output_rpn_tokens_count, enum RPN_ERROR *return_state) {
-    /* Caller is required to free output_rpn_tokens_count. Even on error */
+/*
+ * Shunting-yard state, fed one lex token at a time by 'add_rpn_token'.
+ *   The RPN output and the operator stack share 'tokens': the output grows up
+ *   from the front, the stack grows down from the back. Every lex token adds
+ *   at most one token to the two combined, so a buffer holding one token per
+ *   input char can never overflow.
+ */
+typedef struct {
+    LexToken* tokens;
+    uint32_t tokens_capacity;
+    uint32_t output_count;
+    uint32_t stack_count; // The top of the stack is 'tokens[tokens_capacity - stack_count]'.
+    int32_t open_bracket_count;
+    bool allow_variables;
+    const MEvalRegistry* registry; // May be NULL.
+    bool expect_call_bracket; // The last token was a LT_USER_FUNCTION or LT_NARY_FUNCTION, which must be followed by its '('.
+    enum LEX_TYPE previous_type; // Of the last token added, LT_ERROR before the first.
+} RpnState;
+
+static LexToken* rpn_stack_top(RpnState* state) {
+    return &state->tokens[state->tokens_capacity - state->stack_count];
+}
+
+static void rpn_stack_push(RpnState* state, const LexToken* token) {
+    state->stack_count++;
+    *rpn_stack_top(state) = *token;
+}
+
+static void rpn_stack_pop_to_output(RpnState* state) {
+    LexToken token = *rpn_stack_top(state); // The output may have grown right up to the top of the stack.
+    state->stack_count--;
+    state->tokens[state->output_count++] = token;
+}
 
-    // If want support for both binary and unary functions to overlap (such as -), check if the function has two inputs (a LT_NUMBER or LT_CONST (or maybe a bracket) on either side, if there is only one, the treat as a unary function, else as a binary function).
-    *return_state = RPNE_NONE;
-    *output_rpn_tokens_count = 0;
-    uint32_t rpn_tokens_capcity = lex_token_count;
-    *output_rpn_tokens = MEVAL_MALLOC(rpn_tokens_capcity*sizeof(LexToken));
-    uint32_t token_stack_capacity = 4;
-    uint32_t token_stack_count = 0;
-    LexToken* token_stack = MEVAL_MALLOC(token_stack_capacity*sizeof(LexToken));
-    if ((*output_rpn_tokens) == NULL || token_stack == NULL) {
-        MEVAL_FREE(*output_rpn_tokens); // If NULL does nothing.
-        MEVAL_FREE(token_stack);
-        *return_state = RPNE_FAILED_MEM_ALLOCATION;
+static bool rpn_close_call(RpnState* state, const LexToken* call_bracket) {
+    /*
+     * 'call_bracket' has just been popped, leaving its function on the top of
+     *   the stack. Returns false if the function does not take that many
+     *   arguments, otherwise n-ary functions are given their count.
+     */
+    LexToken* fn_token = rpn_stack_top(state);
+    const uint32_t args_count = call_bracket->value.call_args_count;
+    if (fn_token->type == LT_NARY_FUNCTION) {
+        const NaryFn* fn = &nary_fns[fn_token->value.nary_call.fn];
+        fn_token->value.nary_call.args_count = args_count;
+        return args_count >= fn->min_args_count && args_count <= fn->max_args_count;
+    }
+    return state->registry->fns[fn_token->value.user_fn].args_count == args_count;
+}
+
+static void add_rpn_token(RpnState* state, const LexToken* current_token, enum RPN_ERROR *return_state) {
+    /*
+     * 'return_state' is only set on error.
+     * N-ary and registered functions are called as 'name(a, b, ...)'. Their '(' counts
+     *   the arguments seen so far (see 'LexToken.value.call_args_count'), which
+     *   is checked against the function once the call is closed.
+     */
+    if (state->expect_call_bracket && current_token->type != LT_OPEN_BRACKET) {
+        *return_state = RPNE_MISSING_CALL_BRACKET;
         return;
     }
-    int32_t open_bracket_count = 0;
-    for (uint32_t input_tokens_index = 0; input_tokens_index < lex_token_count; input_tokens_index++) {
-        const LexToken* current_token = &input_lex_tokens[input_tokens_index];
-        if (current_token->type == LT_NUMBER || current_token->type == LT_CONST || (current_token->type == LT_VAR && allow_variables)) {
-            DBPRINT("Pushing number/const(/var if %d==true) into rpn output\n", allow_variables);
-            bool success = add_token(output_rpn_tokens, output_rpn_tokens_count, &rpn_tokens_capcity, *current_token);
-            if (!success) {
-                MEVAL_FREE(token_stack);
-                *return_state = RPNE_FAILED_MEM_ALLOCATION;
-                return;
-            }
-        } else if (current_token->type == LT_OPEN_BRACKET) {
-            DBPRINT("Pushing ( i=%d into token stack\n", current_token->char_index);
-            DBPRINT("  open_bracket_count: %d\n", open_bracket_count);
-            open_bracket_count++;
-            bool success = add_token(&token_stack, &token_stack_count, &token_stack_capacity, *current_token);
-            if (!success) {
-                MEVAL_FREE(token_stack);
-                *return_state = RPNE_FAILED_MEM_ALLOCATION;
-                return;
-            }
-        } else if (current_token->type == LT_CLOSE_BRACKET) {
-            DBPRINT("Found ) in input (at index %d), now handling it ...\n", current_token->char_index);
-            DBPRINT("  Current open_bracket_count: %d\n", open_bracket_count);
-            open_bracket_count--;
-            /*
-            if (token_stack_count == 0) {
-                *return_state = RPNE_MISSING_OPEN_BRACKET;
-                MEVAL_FREE(token_stack);
-                return;
-            }
-            */
-            while (true) {
-                if (token_stack_count == 0) {
-                    // missing an opening bracket (reached end of array, without a open bracket)
+    const bool is_empty_argument = state->previous_type == LT_COMMA
+        || (state->previous_type == LT_OPEN_BRACKET && state->stack_count > 0 && rpn_stack_top(state)->value.call_args_count != 0);
+
+    // If want support for both binary and unary functions to overlap (such as -), check if the function has two inputs (a LT_NUMBER or LT_CONST (or maybe a bracket) on either side, if there is only one, the treat as a unary function, else as a binary function).
+    if (current_token->type == LT_NUMBER || current_token->type == LT_CONST || (current_token->type == LT_VAR && state->allow_variables)) {
+        DBPRINT("Pushing number/const(/var if %d==true) into rpn output\n", state->allow_variables);
+        state->tokens[state->output_count++] = *current_token;
+    } else if (current_token->type == LT_OPEN_BRACKET) {
+        DBPRINT("Pushing ( i=%d into token stack\n", current_token->char_index);
+        DBPRINT("  open_bracket_count: %d\n", state->open_bracket_count);
+        state->open_bracket_count++;
+        LexToken bracket = *current_token;
+        bracket.value.call_args_count = state->expect_call_bracket ? 1 : 0;
+        state->expect_call_bracket = false;
+        rpn_stack_push(state, &bracket);
+    } else if (current_token->type == LT_CLOSE_BRACKET) {
+        DBPRINT("Found ) in input (at index %d), now handling it ...\n", current_token->char_index);
+        DBPRINT("  Current open_bracket_count: %d\n", state->open_bracket_count);
+        state->open_bracket_count--;
+        while (true) {
+            if (state->stack_count == 0) {
+                // missing an opening bracket (reached end of array, without a open bracket)
 #if defined(MEVAL_OPT_ALLOW_MISSING_OPEN_BRACKET) && MEVAL_OPT_ALLOW_MISSING_OPEN_BRACKET == 1
-                    break;
+                break;
 #else
-                    DBPRINT("  Missing open bracket, count: %d ... returning with errored state\n", open_bracket_count);
-                    MEVAL_FREE(token_stack);
-                    *return_state = RPNE_MISSING_OPEN_BRACKET;
-                    return;
+                DBPRINT("  Missing open bracket, count: %d ... returning with errored state\n", state->open_bracket_count);
+                *return_state = RPNE_MISSING_OPEN_BRACKET;
+                return;
 #endif
-                }
-                current_token = &token_stack[token_stack_count-1];
-                if (current_token->type == LT_OPEN_BRACKET) { // Only used as a marker on where to stop
-                    DBPRINT("  Found ( i=%d in closing bracket search, ending proccessing\n", current_token->char_index);
-                    token_stack_count--; // Remove the open bracket, as its no longer needed.
-                    break;
-                }
-                DBPRINT("  token (i=%d, t=%d, ", current_token->char_index, current_token->type);
-                print_token_value(*current_token);
-                DBPRINT(") being added to output token stack\n");
-                bool success = add_token(output_rpn_tokens, output_rpn_tokens_count, &rpn_tokens_capcity, *current_token);
-                if (!success) {
-                    MEVAL_FREE(token_stack);
-                    *return_state = RPNE_FAILED_MEM_ALLOCATION;
-                    return;
-                }
-                token_stack_count--;
-            }
-        } else if (current_token->type == LT_UNARY_FUNCTION || current_token->type == LT_BINARY_FUNCTION) {
-            DBPRINT("Pushing function (type=%d) to token stack, ", current_token->type);
-            print_token_value(*current_token);
-            DBPRINT("\n");
-            uint32_t stack_top_precedence = 0;
-            if (token_stack_count > 0) {
-                stack_top_precedence = get_fn_precedence(&token_stack[token_stack_count-1]);
-            }
-            uint32_t current_precedence = get_fn_precedence(current_token);
-            bool success = true;
-            while (token_stack_count > 0) {
-                DBPRINT("  moving token (i=%d, t=%d) from token stack to rpn output\n", token_stack[token_stack_count-1].char_index, token_stack[token_stack_count-1].type);
-                stack_top_precedence = get_fn_precedence(&token_stack[token_stack_count-1]);
-                if (stack_top_precedence < current_precedence) {
-                    break;
-                }
-                success = add_token(output_rpn_tokens, output_rpn_tokens_count, &rpn_tokens_capcity, token_stack[token_stack_count-1]);
-                if (!success) {
-                    MEVAL_FREE(token_stack);
-                    *return_state = RPNE_FAILED_MEM_ALLOCATION;
+            }
+            const LexToken* stack_top = rpn_stack_top(state);
+            if (stack_top->type == LT_OPEN_BRACKET) { // Only used as a marker on where to stop
+                DBPRINT("  Found ( i=%d in closing bracket search, ending proccessing\n", stack_top->char_index);
+                const LexToken bracket = *stack_top;
+                state->stack_count--; // Remove the open bracket, as its no longer needed.
+                if (bracket.value.call_args_count != 0 && (is_empty_argument || !rpn_close_call(state, &bracket))) {
+                    *return_state = is_empty_argument ? RPNE_MISSING_ARGUMENT : RPNE_WRONG_ARGS_COUNT;
                     return;
                 }
-                token_stack_count--;
+                break;
             }
-            success = add_token(&token_stack, &token_stack_count, &token_stack_capacity, *current_token);
-            if (!success) {
-                MEVAL_FREE(token_stack);
-                *return_state = RPNE_FAILED_MEM_ALLOCATION;
-                return;
+            DBPRINT("  token (i=%d, t=%d, ", stack_top->char_index, stack_top->type);
+            print_token_value(*stack_top);
+            DBPRINT(") being added to output token stack\n");
+            rpn_stack_pop_to_output(state);
+        }
+    } else if (current_token->type == LT_UNARY_FUNCTION || current_token->type == LT_BINARY_FUNCTION) {
+        DBPRINT("Pushing function (type=%d) to token stack, ", current_token->type);
+        print_token_value(*current_token);
+        DBPRINT("\n");
+        uint32_t current_precedence = get_fn_precedence(current_token);
+        while (state->stack_count > 0) {
+            DBPRINT("  moving token (i=%d, t=%d) from token stack to rpn output\n", rpn_stack_top(state)->char_index, rpn_stack_top(state)->type);
+            if (get_fn_precedence(rpn_stack_top(state)) < current_precedence) {
+                break;
             }
+            rpn_stack_pop_to_output(state);
         }
-    }
-    for (uint32_t i=token_stack_count-1; i+1 != 0; i--) {
-        // pop all the remaining tokens from the tokens stack.
-        DBPRINT("Poping remaining token (i=%d, t=%d)\n", token_stack[i].char_index, token_stack[i].type);
-        if (token_stack[i].type == LT_OPEN_BRACKET) {
-            DBPRINT(" Ignoring open bracket at stack index %d\n", i);
-            continue; // Assume the closing bracket was ment to be at the end.
+        rpn_stack_push(state, current_token);
+    } else if (current_token->type == LT_USER_FUNCTION || current_token->type == LT_NARY_FUNCTION) {
+        rpn_stack_push(state, current_token); // Always prefix, so nothing on the stack can be one of its operands.
+        state->expect_call_bracket = true;
+    } else if (current_token->type == LT_COMMA) {
+        if (is_empty_argument) {
+            *return_state = RPNE_MISSING_ARGUMENT;
+            return;
+        }
+        while (state->stack_count > 0 && rpn_stack_top(state)->type != LT_OPEN_BRACKET) {
+            rpn_stack_pop_to_output(state);
         }
-        add_token(output_rpn_tokens, output_rpn_tokens_count, &rpn_tokens_capcity, token_stack[i]);
+        if (state->stack_count == 0 || rpn_stack_top(state)->value.call_args_count == 0) {
+            *return_state = RPNE_MISPLACED_COMMA;
+            return;
+        }
+        rpn_stack_top(state)->value.call_args_count++;
     }
-    MEVAL_FREE(token_stack);
+    state->previous_type = current_token->type;
 }
 
-void eval_rpn_tokens(const LexToken* input_rpn_tokens, const uint32_t input_rpn_token_count, bool allow_variables, const MEvalVar* variables_array_ptr, const uint32_t variables_array_element_count, double* output_value, enum EVAL_ERROR *return_state) {
-    *output_value = 0;
-    *return_state = EE_NONE;
-    uint32_t number_stack_count = 0;
-    uint32_t number_stack_capacity = 8;
-    LexToken* number_stack = MEVAL_MALLOC(number_stack_capacity*sizeof(LexToken));
-    if (number_stack == NULL) {
-        *return_state = EE_FAILED_MEM_ALLOCATION;
+static void finish_rpn_tokens(RpnState* state, enum RPN_ERROR *return_state) {
+    /* Pops all the remaining tokens from the tokens stack. 'return_state' is only set on error */
+    if (state->expect_call_bracket) {
+        *return_state = RPNE_MISSING_CALL_BRACKET;
         return;
     }
-    bool success = true;
-    for (uint32_t input_tokens_index = 0; input_tokens_index < input_rpn_token_count; input_tokens_index++) {
-        const LexToken* current_token = &input_rpn_tokens[input_tokens_index];
-        if (current_token->type == LT_NUMBER) {
-            success = add_token(&number_stack, &number_stack_count, &number_stack_capacity, *current_token);
-            if (!success) {
-                *return_state = EE_FAILED_MEM_ALLOCATION;
-                MEVAL_FREE(number_stack);
+    bool is_empty_argument = state->previous_type == LT_COMMA || state->previous_type == LT_OPEN_BRACKET;
+    while (state->stack_count > 0) {
+        DBPRINT("Poping remaining token (i=%d, t=%d)\n", rpn_stack_top(state)->char_index, rpn_stack_top(state)->type);
+        if (rpn_stack_top(state)->type == LT_OPEN_BRACKET) {
+            DBPRINT(" Ignoring open bracket\n");
+            const LexToken bracket = *rpn_stack_top(state);
+            state->stack_count--;
+            if (bracket.value.call_args_count != 0 && (is_empty_argument || !rpn_close_call(state, &bracket))) {
+                *return_state = is_empty_argument ? RPNE_MISSING_ARGUMENT : RPNE_WRONG_ARGS_COUNT;
                 return;
             }
-        } else if (current_token->type == LT_CONST) {
-            LexToken new_token = *current_token;
-            new_token.type = LT_NUMBER;
-            new_token.value.number = 0;
-            for (size_t i=0; i < constants_count; i++) {
-                if ((size_t)current_token->value.const_name == i) {
-                    new_token.value.number = constants[i].value;
-                    break;
-                }
+            is_empty_argument = false; // Only the innermost call can end on an empty argument.
+            continue; // Assume the closing bracket was ment to be at the end.
+        }
+        rpn_stack_pop_to_output(state);
+    }
+}
+
+typedef struct {
+    uint32_t start_index; // Index of the first token of the sub-expression, its last token is always the operation producing its value.
+    bool is_number; // The whole sub-expression is a single LT_NUMBER token.
+} FoldOperand;
+
+static bool is_number_token(const LexToken* token, double number) {
+    /* Exact (bitwise) comparison, to tell 0 and -0 apart */
+    return token->type == LT_NUMBER && memcmp(&token->value.number, &number, sizeof(double)) == 0;
+}
+
+static bool is_foldable_binary_fn(enum BINARY_FUNCTION_NAMES fn, double b) {
+    /* 'fn_mod' casts to size_t, a divisor that casts to 0 (or outside size_t range) traps, so is left to runtime, where it may never run */
+    return fn != BFN_MOD || (b >= 1 && b < 18446744073709551616.0);
+}
+
+static uint32_t fold_rpn_constants(LexToken* rpn_tokens, const uint32_t rpn_tokens_count, bool allow_variables, const MEvalRegistry* registry, const MEvalAllocator* allocator) {
+    /*
+     * Optimisation pass over the output of 'gen_reverse_polish_notation', done
+     *   in place. Returns the new token count.
+     * - Every sub-expression without a variable is evaluated into a single
+     *   LT_NUMBER (constants are always turned into numbers).
+     * - Identities that hold for every IEEE 754 value are removed, x*1, 1*x,
+     *   x/1, x^1, x-0, x+(-0), (-0)+x and _(_x). x+0 is *not* removed, as
+     *   -0+0 is 0.
+     * - x*(-1) and (-1)*x become _x.
+     * - N-ary and pure registered functions are called when every argument is a number.
+     * - 'if' with a number as condition becomes the branch it picks, as do
+     *   '&' and '|' whose first operand alone decides them.
+     * If the tokens are invalid (operands missing) folding stops, and the
+     *   remaining tokens are kept as they are, for 'gen_stack_depth' to report.
+     */
+    FoldOperand* operands = allocator_alloc(allocator, MAX(rpn_tokens_count, 1)*sizeof(FoldOperand));
+    if (operands == NULL) {
+        return rpn_tokens_count; // Folding is optional.
+    }
+    uint32_t operands_count = 0;
+    uint32_t output_count = 0;
+    uint32_t input_index = 0;
+    for (; input_index < rpn_tokens_count; input_index++) {
+        LexToken current_token = rpn_tokens[input_index];
+        if (current_token.type == LT_NUMBER || current_token.type == LT_CONST || (current_token.type == LT_VAR && allow_variables)) {
+            if (current_token.type == LT_CONST) {
+                current_token.value.number = constants[current_token.value.const_name].value;
+                current_token.type = LT_NUMBER;
             }
-            success = add_token(&number_stack, &number_stack_count, &number_stack_capacity, new_token);
-            if (!success) {
-                *return_state = EE_FAILED_MEM_ALLOCATION;
-                MEVAL_FREE(number_stack);
-                return;
+            operands[operands_count++] = (FoldOperand){.start_index=output_count, .is_number=current_token.type == LT_NUMBER};
+            rpn_tokens[output_count++] = current_token;
+        } else if (current_token.type == LT_UNARY_FUNCTION) {
+            if (operands_count < 1) {
+                break;
             }
-        } else if (current_token->type == LT_VAR && allow_variables) {
-            int32_t var_index = -1;
-            DBPRINT("db: checking against %d variables\n", variables_array_element_count);
-            for (size_t i=0; i < variables_array_element_count; i++) {
-                DBPRINT("db:  Checking variable '%s'\n", variables_array_ptr[i].name);
-                if (strcmp(current_token->value.var_name, variables_array_ptr[i].name) == 0) {
-                    var_index = i;
-                    break;
+            FoldOperand* operand = &operands[operands_count-1];
+            if (operand->is_number) {
+                double* number = &rpn_tokens[operand->start_index].value.number;
+                *number = unary_fns[current_token.value.unary_fn].fnptr(*number);
+            } else if (current_token.value.unary_fn == UFN_NEGATE && rpn_tokens[output_count-1].type == LT_UNARY_FUNCTION && rpn_tokens[output_count-1].value.unary_fn == UFN_NEGATE) {
+                output_count--; // _(_x) is x
+            } else {
+                rpn_tokens[output_count++] = current_token;
+            }
+        } else if (current_token.type == LT_BINARY_FUNCTION) {
+            if (operands_count < 2) {
+                break;
+            }
+            FoldOperand operand_b = operands[--operands_count];
+            FoldOperand* operand_a = &operands[operands_count-1];
+            const enum BINARY_FUNCTION_NAMES fn = current_token.value.binary_fn;
+            const LexToken* token_a = &rpn_tokens[operand_a->start_index];
+            const LexToken* token_b = &rpn_tokens[operand_b.start_index];
+            if (operand_a->is_number && operand_b.is_number && is_foldable_binary_fn(fn, token_b->value.number)) {
+                rpn_tokens[operand_a->start_index].value.number = binary_fns[fn].fnptr(token_a->value.number, token_b->value.number);
+                output_count = operand_a->start_index+1;
+            } else if (operand_a->is_number && ((fn == BFN_AND && token_a->value.number == 0) || (fn == BFN_OR && token_a->value.number != 0))) {
+                rpn_tokens[operand_a->start_index].value.number = binary_fns[fn].fnptr(token_a->value.number, 0); // b is never evaluated.
+                output_count = operand_a->start_index+1;
+            } else if (operand_b.is_number && (((fn == BFN_MUL || fn == BFN_DIV || fn == BFN_POW) && is_number_token(token_b, 1))
+                        || (fn == BFN_SUB && is_number_token(token_b, 0)) || (fn == BFN_ADD && is_number_token(token_b, -0.0)))) {
+                output_count = operand_b.start_index; // Drop b, leaving a.
+            } else if (operand_a->is_number && ((fn == BFN_MUL && is_number_token(token_a, 1)) || (fn == BFN_ADD && is_number_token(token_a, -0.0)))) {
+                // Drop a, moving b down to where a started.
+                memmove(&rpn_tokens[operand_a->start_index], &rpn_tokens[operand_b.start_index], (output_count - operand_b.start_index)*sizeof(LexToken));
+                output_count -= operand_b.start_index - operand_a->start_index;
+                operand_a->is_number = false;
+            } else if (fn == BFN_MUL && ((operand_b.is_number && is_number_token(token_b, -1)) || (operand_a->is_number && is_number_token(token_a, -1)))) {
+                if (operand_a->is_number) { // Drop a, as above.
+                    memmove(&rpn_tokens[operand_a->start_index], &rpn_tokens[operand_b.start_index], (output_count - operand_b.start_index)*sizeof(LexToken));
+                    output_count -= operand_b.start_index - operand_a->start_index;
+                    operand_a->is_number = false;
+                } else { // Drop b.
+                    output_count = operand_b.start_index;
                 }
+                if (rpn_tokens[output_count-1].type == LT_UNARY_FUNCTION && rpn_tokens[output_count-1].value.unary_fn == UFN_NEGATE) {
+                    output_count--;
+                } else {
+                    current_token.type = LT_UNARY_FUNCTION;
+                    current_token.value.unary_fn = UFN_NEGATE;
+                    rpn_tokens[output_count++] = current_token;
+                }
+            } else {
+                rpn_tokens[output_count++] = current_token;
+                operand_a->is_number = false;
             }
-            if (var_index == -1) {
-                DBPRINT("db: Could not find variable with name '%s', but used in expression\n", current_token->value.var_name);
-                *return_state = EE_USE_OF_UNDEFINED_VAR;
-                MEVAL_FREE(number_stack);
-                return;
+        } else if (current_token.type == LT_USER_FUNCTION || current_token.type == LT_NARY_FUNCTION) {
+            const bool is_nary = current_token.type == LT_NARY_FUNCTION;
+            const RegisteredFn* fn = is_nary ? NULL : &registry->fns[current_token.value.user_fn];
+            const uint32_t args_count = is_nary ? current_token.value.nary_call.args_count : fn->args_count;
+            if (operands_count < args_count) {
+                break;
             }
-            LexToken new_token = *current_token;
-            new_token.type = LT_NUMBER;
-            new_token.value.number = variables_array_ptr[var_index].value;
-            success = add_token(&number_stack, &number_stack_count, &number_stack_capacity, new_token);
-            if (!success) {
-                *return_state = EE_FAILED_MEM_ALLOCATION;
-                MEVAL_FREE(number_stack);
-                return;
+            operands_count -= args_count - 1;
+            FoldOperand* first_operand = &operands[operands_count-1];
+            bool all_numbers = is_nary || fn->pure;
+            for (uint32_t i=0; i < args_count && all_numbers; i++) {
+                all_numbers = first_operand[i].is_number;
             }
+            if (is_nary && current_token.value.nary_call.fn == NFN_IF && first_operand[0].is_number) {
+                // Keep only the branch the condition picks, moving it down to where the condition started.
+                const FoldOperand* branch = &first_operand[rpn_tokens[first_operand[0].start_index].value.number != 0 ? 1 : 2];
+                const uint32_t branch_end = branch == &first_operand[1] ? first_operand[2].start_index : output_count;
+                memmove(&rpn_tokens[first_operand->start_index], &rpn_tokens[branch->start_index], (branch_end - branch->start_index)*sizeof(LexToken));
+                output_count = first_operand->start_index + (branch_end - branch->start_index);
+                first_operand->is_number = branch->is_number;
+            } else if (all_numbers) { // Each argument is a single token, so they are contiguous.
+                double args[CALL_MAX_ARGS_COUNT];
+                for (uint32_t i=0; i < args_count; i++) {
+                    args[i] = rpn_tokens[first_operand->start_index + i].value.number;
+                }
+                double* number = &rpn_tokens[first_operand->start_index].value.number;
+                *number = is_nary ? nary_fns[current_token.value.nary_call.fn].fnptr(args, args_count) : call_registered_fn(fn, args);
+                output_count = first_operand->start_index+1;
+            } else {
+                rpn_tokens[output_count++] = current_token;
+                first_operand->is_number = false;
+            }
+        } else {
+            rpn_tokens[output_count++] = current_token; // Ignored by every later stage.
+        }
+    }
+    // Keep anything left after an invalid token as it is.
+    for (; input_index < rpn_tokens_count; input_index++) {
+        rpn_tokens[output_count++] = rpn_tokens[input_index];
+    }
+    allocator_free(allocator, operands);
+    DBPRINT("Constant folding: %u -> %u tokens\n", rpn_tokens_count, output_count);
+    return output_count;
+}
+
+static void gen_stack_depth(const LexToken* input_rpn_tokens, const uint32_t input_rpn_token_count, bool allow_variables, const MEvalRegistry* registry, uint32_t* output_max_stack_depth, uint32_t* output_error_token_index, enum EVAL_ERROR *return_state) {
+    /*
+     * Simulates the number stack of 'eval_rpn_tokens' without evaluating
+     *   anything, finding the deepest the stack gets and any operand errors.
+     * On error, '*output_error_token_index' is the index of the token that
+     *   caused it.
+     */
+    *return_state = EE_NONE;
+    *output_max_stack_depth = 0;
+    *output_error_token_index = 0;
+    uint32_t stack_depth = 0;
+    for (uint32_t input_tokens_index = 0; input_tokens_index < input_rpn_token_count; input_tokens_index++) {
+        const LexToken* current_token = &input_rpn_tokens[input_tokens_index];
+        if (current_token->type == LT_NUMBER || current_token->type == LT_CONST || (current_token->type == LT_VAR && allow_variables)) {
+            stack_depth++;
+            *output_max_stack_depth = MAX(*output_max_stack_depth, stack_depth);
         } else if (current_token->type == LT_UNARY_FUNCTION) {
-            if (number_stack_count < 1) {
+            if (stack_depth < 1) {
                 *return_state = EE_NOT_ENOUGH_OPERANDS;
-                MEVAL_FREE(number_stack);
-                return;
-            }
-            LexToken evaluated_value = {0};
-            evaluated_value.type = LT_NUMBER;
-            evaluated_value.char_index = current_token->char_index; // Give the char_index, the functions char_index that it was evaluated from.
-            evaluated_value.error_type = LE_NONE;
-            double value = number_stack[--number_stack_count].value.number; // Assume this token is a number token.
-            evaluated_value.value.number = unary_fns[current_token->value.unary_fn].fnptr(value);
-            success = add_token(&number_stack, &number_stack_count, &number_stack_capacity, evaluated_value);
-            if (!success) {
-                *return_state = EE_FAILED_MEM_ALLOCATION;
-                MEVAL_FREE(number_stack);
+                *output_error_token_index = input_tokens_index;
                 return;
             }
-            // use the precedence to determine what to do with this
         } else if (current_token->type == LT_BINARY_FUNCTION) {
-            if (number_stack_count < 2) {
+            if (stack_depth < 2) {
                 *return_state = EE_NOT_ENOUGH_OPERANDS;
-                MEVAL_FREE(number_stack);
+                *output_error_token_index = input_tokens_index;
                 return;
             }
-            LexToken evaluated_value = {0};
-            evaluated_value.type = LT_NUMBER;
-            evaluated_value.char_index = current_token->char_index; // Give the char_index, the functions char_index that it was evaluated from.
-            evaluated_value.error_type = LE_NONE;
-            double value_b = number_stack[--number_stack_count].value.number; // Assume token is a valid number, if it is in the number stack.
-            double value_a = number_stack[--number_stack_count].value.number; // Assume token is a valid number, if it is in the number stack.
-            evaluated_value.value.number = binary_fns[current_token->value.binary_fn].fnptr(value_a, value_b);
-            success = add_token(&number_stack, &number_stack_count, &number_stack_capacity, evaluated_value);
-            if (!success) {
-                *return_state = EE_FAILED_MEM_ALLOCATION;
-                MEVAL_FREE(number_stack);
+            stack_depth--;
+        } else if (current_token->type == LT_USER_FUNCTION || current_token->type == LT_NARY_FUNCTION) {
+            const uint32_t args_count = current_token->type == LT_NARY_FUNCTION
+                ? current_token->value.nary_call.args_count : registry->fns[current_token->value.user_fn].args_count;
+            if (stack_depth < args_count) {
+                *return_state = EE_NOT_ENOUGH_OPERANDS;
+                *output_error_token_index = input_tokens_index;
                 return;
             }
-            // use the precedence to determine what to do with this
-        } // Ignore unknown types (these should have been handled by an earlier stage). I guess this now includes variables.
+            stack_depth -= args_count - 1;
+        } // Ignore unknown types, as 'eval_rpn_tokens' does.
     }
-    if (number_stack_count != 1) {
+    if (stack_depth != 1) {
         *return_state = EE_TOO_MANY_OPERANDS;
-        MEVAL_FREE(number_stack);
-        return;
+        *output_error_token_index = input_rpn_token_count > 0 ? input_rpn_token_count-1 : 0;
     }
-    // TODO: Go through every element, and make sure that a binary function does not have another binary function adjacent (directly next to it).
-    //    Unary functions can be ignored, because unary functions can have parameters from the left or the right, or may even have another unary function next to it.
-    *output_value = number_stack[0].value.number;
-    MEVAL_FREE(number_stack);
 }
 
-bool meval_append_variable(MEvalVarArr *variables_array, MEvalVar new_variable) {
-    if (variables_array->elements_count >= variables_array->capacity_elements) {
-        uint32_t new_capacity = MAX(variables_array->capacity_elements * 1.5, 3);
-        MEvalVar* tmp = MEVAL_REALLOCARRAY(variables_array->arr_ptr, new_capacity, sizeof(MEvalVar));
-        if (tmp == NULL) {
-            return false;
-        }
-        variables_array->arr_ptr = tmp;
-        variables_array->capacity_elements = new_capacity;
-    }
-    variables_array->arr_ptr[variables_array->elements_count] = new_variable;
-    variables_array->elements_count++;
-    return true;
+typedef struct {
+    uint8_t op; // Jump placed in front of the token, OP_END for none.
+    uint32_t ops_index; // Where the jump was placed, its operands start at 'operands_index'.
+    uint32_t numbers_index;
+    uint32_t operands_index;
+} JumpSite;
+
+static void set_jump_target(uint32_t* jump_operands, uint32_t ops_index, uint32_t numbers_index, uint32_t operands_index) {
+    jump_operands[0] = ops_index;
+    jump_operands[1] = numbers_index;
+    jump_operands[2] = operands_index;
 }
 
-void free_variable_arr(MEvalVarArr *variables_array) {
-    MEVAL_FREE(variables_array->arr_ptr);
-    variables_array->elements_count = 0;
-    variables_array->capacity_elements = 0;
+static bool is_jump_op(uint8_t op) {
+    return op >= OP_JUMP_IF_FALSE && op <= OP_SKIP_IF_TRUE;
+}
+
+static const NaryFn* get_nary_fn(uint8_t op) {
+    /* Of an OP_NARY_FN instruction, or of OP_SELECT for evaluators that ignore jumps */
+    return op == OP_SELECT ? &nary_fns[NFN_IF] : &nary_fns[op - OP_NARY_FN];
 }
 
-static void meval_internal_compile_expr(const char* input_string, bool support_variables, const MEvalVarArr expected_variables, LexToken** output_rpn_tokens, uint32_t *output_rpn_tokens_count, MEvalError* output_error) {
+static bool gen_bytecode(const LexToken* input_rpn_tokens, const uint32_t input_rpn_token_count, MEvalCompiledExpr* output_compiled_expr) {
     /*
-     * Note: 'expected_variables' maybe empty. If its empty, every
-     *    unrecognised/ambigious function is assumed to be a variable.
-     * Note: If 'expected_variables' is not empty (contains some varibles within
-     *    it), only unrecognised functions or identifiers that match the
-     *    expected variables name exactly are assumed as variables.
+     * Lowers validated RPN tokens (see 'gen_stack_depth'), whose variables
+     *   have already been given a var_id (see 'gen_var_table'), into bytecode.
+     *   'output_compiled_expr->registry' is cleared when no registered
+     *   function is called, so the bytecode does not depend on it.
+     * The jumps of '&', '|' and 'if' (see 'enum OPCODE') go in front of their
+     *   later operands, found by tracking where each operand's tokens start.
+     *   No token starts more than one such operand, as the operand starting
+     *   at a token is the largest sub-expression starting there.
+     * Returns false on a failed allocation.
      */
-    *output_rpn_tokens = NULL;
-    *output_rpn_tokens_count = 0;
-    if (input_string == NULL) {
-        output_error->type = MEVAL_LEX_ERROR;
-        output_error->char_index = 0;
-        strncpy(output_error->message, "No Input Given", MEVAL_ERROR_STRING_LEN);
-        output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
-        return;
+    uint32_t numbers_count = 0;
+    uint32_t operands_count = 0;
+    uint32_t ops_count = 0;
+    uint32_t jumps_count = 0;
+    for (uint32_t i=0; i < input_rpn_token_count; i++) {
+        const LexToken* token = &input_rpn_tokens[i];
+        const enum LEX_TYPE type = token->type;
+        numbers_count += type == LT_NUMBER || type == LT_CONST;
+        operands_count += type == LT_VAR || (type == LT_NARY_FUNCTION && token->value.nary_call.fn != NFN_IF) || type == LT_USER_FUNCTION;
+        ops_count += type == LT_NUMBER || type == LT_CONST || type == LT_VAR || type == LT_UNARY_FUNCTION || type == LT_BINARY_FUNCTION
+            || type == LT_NARY_FUNCTION || type == LT_USER_FUNCTION;
+        jumps_count += type == LT_BINARY_FUNCTION && (token->value.binary_fn == BFN_AND || token->value.binary_fn == BFN_OR);
+        jumps_count += type == LT_NARY_FUNCTION && token->value.nary_call.fn == NFN_IF ? 2 : 0;
     }
-    LexToken* lex_tokens = NULL;
-    uint32_t lex_tokens_count = 0;
-    bool error_occured = false;
-    const char* error_string = NULL;
-    gen_lex_tokens(input_string, strlen(input_string), support_variables, expected_variables, &lex_tokens, &lex_tokens_count, &error_occured);
-    if (lex_tokens_count == 0) {
-        output_error->type = MEVAL_LEX_ERROR;
-        output_error->char_index = 0;
-        strncpy(output_error->message, "Empty/Invalid Text Input", MEVAL_ERROR_STRING_LEN);
-        output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
-        return;
+    ops_count += jumps_count;
+    operands_count += jumps_count*JUMP_OPERANDS_COUNT;
+    uint8_t* code = allocator_alloc(&output_compiled_expr->allocator, numbers_count*sizeof(double) + operands_count*sizeof(uint32_t) + ops_count+1);
+    uint32_t* operand_starts = NULL; // RPN index where each operand on the stack starts.
+    JumpSite* jump_sites = NULL; // Per RPN token.
+    if (jumps_count > 0) {
+        operand_starts = allocator_alloc(&output_compiled_expr->allocator, input_rpn_token_count*(sizeof(uint32_t) + sizeof(JumpSite)));
+        jump_sites = (JumpSite*)(operand_starts + input_rpn_token_count);
     }
-    DBPRINT("%d lex_tokens emitted, error_occured: %d\n", lex_tokens_count, error_occured);
-    for (size_t i=0; i < lex_tokens_count; i++) {
-        print_token(lex_tokens[i]);
+    if (code == NULL || (jumps_count > 0 && operand_starts == NULL)) {
+        allocator_free(&output_compiled_expr->allocator, code);
+        allocator_free(&output_compiled_expr->allocator, operand_starts);
+        return false;
     }
-    if (error_occured) {
-        for (size_t i=0; i < lex_tokens_count; i++) {
-            if (lex_tokens[i].type == LT_ERROR) {
-                output_error->type = MEVAL_LEX_ERROR;
-                output_error->char_index = lex_tokens[i].char_index;
-                strncpy(output_error->message, lex_tokens[i].value.error_str, MEVAL_ERROR_STRING_LEN);
-                output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
-                MEVAL_FREE(lex_tokens);
-                return;
+    output_compiled_expr->numbers = (double*)code;
+    output_compiled_expr->operands = (uint32_t*)(code + numbers_count*sizeof(double));
+    output_compiled_expr->ops = code + numbers_count*sizeof(double) + operands_count*sizeof(uint32_t);
+    output_compiled_expr->numbers_count = numbers_count;
+    output_compiled_expr->operands_count = operands_count;
+    output_compiled_expr->ops_count = ops_count;
+
+    uint32_t starts_count = 0;
+    for (uint32_t i=0; i < input_rpn_token_count && jumps_count > 0; i++) {
+        const LexToken* current_token = &input_rpn_tokens[i];
+        jump_sites[i].op = OP_END;
+        if (current_token->type == LT_NUMBER || current_token->type == LT_CONST || current_token->type == LT_VAR) {
+            operand_starts[starts_count++] = i;
+        } else if (current_token->type == LT_BINARY_FUNCTION) {
+            const uint32_t start_b = operand_starts[--starts_count];
+            if (current_token->value.binary_fn == BFN_AND || current_token->value.binary_fn == BFN_OR) {
+                jump_sites[start_b].op = current_token->value.binary_fn == BFN_AND ? OP_SKIP_IF_FALSE : OP_SKIP_IF_TRUE;
+            }
+        } else if (current_token->type == LT_NARY_FUNCTION || current_token->type == LT_USER_FUNCTION) {
+            const uint32_t args_count = current_token->type == LT_NARY_FUNCTION
+                ? current_token->value.nary_call.args_count : output_compiled_expr->registry->fns[current_token->value.user_fn].args_count;
+            starts_count -= args_count - 1;
+            if (current_token->type == LT_NARY_FUNCTION && current_token->value.nary_call.fn == NFN_IF) {
+                jump_sites[operand_starts[starts_count]].op = OP_JUMP_IF_FALSE;
+                jump_sites[operand_starts[starts_count+1]].op = OP_JUMP;
+            }
+        } // Unary functions start where their operand does.
+    }
+
+    uint32_t numbers_index = 0;
+    uint32_t operands_index = 0;
+    uint32_t ops_index = 0;
+    bool calls_registered_fn = false;
+    starts_count = 0;
+    for (uint32_t i=0; i < input_rpn_token_count; i++) {
+        const LexToken* current_token = &input_rpn_tokens[i];
+        if (jump_sites != NULL && jump_sites[i].op != OP_END) {
+            jump_sites[i].ops_index = ops_index;
+            jump_sites[i].numbers_index = numbers_index;
+            jump_sites[i].operands_index = operands_index;
+            output_compiled_expr->ops[ops_index++] = jump_sites[i].op;
+            operands_index += JUMP_OPERANDS_COUNT; // Set once the jump's target is emitted.
+        }
+        if (current_token->type == LT_NUMBER) {
+            output_compiled_expr->numbers[numbers_index++] = current_token->value.number;
+            output_compiled_expr->ops[ops_index++] = OP_NUMBER;
+            starts_count++;
+        } else if (current_token->type == LT_CONST) {
+            output_compiled_expr->numbers[numbers_index++] = constants[current_token->value.const_name].value;
+            output_compiled_expr->ops[ops_index++] = OP_NUMBER;
+            starts_count++;
+        } else if (current_token->type == LT_VAR) {
+            output_compiled_expr->operands[operands_index++] = current_token->value.var_id;
+            output_compiled_expr->ops[ops_index++] = OP_VAR;
+            starts_count++;
+        } else if (current_token->type == LT_UNARY_FUNCTION) {
+            output_compiled_expr->ops[ops_index++] = OP_UNARY_FN + current_token->value.unary_fn;
+        } else if (current_token->type == LT_BINARY_FUNCTION) {
+            output_compiled_expr->ops[ops_index++] = OP_BINARY_FN + current_token->value.binary_fn;
+            starts_count--;
+            if (current_token->value.binary_fn == BFN_AND || current_token->value.binary_fn == BFN_OR) {
+                const JumpSite* skip = &jump_sites[operand_starts[starts_count]];
+                set_jump_target(&output_compiled_expr->operands[skip->operands_index], ops_index, numbers_index, operands_index);
             }
+        } else if (current_token->type == LT_NARY_FUNCTION && current_token->value.nary_call.fn == NFN_IF) {
+            starts_count -= 2;
+            output_compiled_expr->ops[ops_index++] = OP_SELECT;
+            const JumpSite* jump_if_false = &jump_sites[operand_starts[starts_count]];
+            const JumpSite* jump = &jump_sites[operand_starts[starts_count+1]];
+            set_jump_target(&output_compiled_expr->operands[jump_if_false->operands_index],
+                jump->ops_index+1, jump->numbers_index, jump->operands_index + JUMP_OPERANDS_COUNT);
+            set_jump_target(&output_compiled_expr->operands[jump->operands_index], ops_index, numbers_index, operands_index);
+        } else if (current_token->type == LT_NARY_FUNCTION) {
+            output_compiled_expr->operands[operands_index++] = current_token->value.nary_call.args_count;
+            output_compiled_expr->ops[ops_index++] = OP_NARY_FN + current_token->value.nary_call.fn;
+            starts_count -= current_token->value.nary_call.args_count - 1;
+        } else if (current_token->type == LT_USER_FUNCTION) {
+            output_compiled_expr->operands[operands_index++] = current_token->value.user_fn;
+            output_compiled_expr->ops[ops_index++] = output_compiled_expr->registry->fns[current_token->value.user_fn].op;
+            starts_count -= output_compiled_expr->registry->fns[current_token->value.user_fn].args_count - 1;
+            calls_registered_fn = true;
+        } // Ignore unknown types (these should have been handled by an earlier stage).
+        if (operand_starts != NULL && (current_token->type == LT_NUMBER || current_token->type == LT_CONST || current_token->type == LT_VAR)) {
+            operand_starts[starts_count-1] = i;
         }
-        // Error occured ... But cannot find it?????
-        abort();
     }
-    enum RPN_ERROR rpn_error = RPNE_NONE;
-    gen_reverse_polish_notation(lex_tokens, lex_tokens_count, support_variables, output_rpn_tokens, output_rpn_tokens_count, &rpn_error);
-    MEVAL_FREE(lex_tokens);
-    for (size_t i=0; i < (*output_rpn_tokens_count); i++) {
-        DBPRINT("RPN Token: ");
-        print_token((*output_rpn_tokens)[i]);
+    output_compiled_expr->ops[ops_index] = OP_END;
+    allocator_free(&output_compiled_expr->allocator, operand_starts);
+    if (!calls_registered_fn) {
+        output_compiled_expr->registry = NULL;
     }
-    if (rpn_error != RPNE_NONE) {
-        DBPRINT("RPN Error occured (%d)\n", rpn_error);
-        output_error->type = MEVAL_PARSE_ERROR;
-        if ((*output_rpn_tokens_count) != 0) {
-            output_error->char_index = (*output_rpn_tokens)[(*output_rpn_tokens_count)-1].char_index;
-            *output_rpn_tokens_count = 0;
-        } else {
-            output_error->char_index = 0;
-        }
-        MEVAL_FREE(*output_rpn_tokens);
-        *output_rpn_tokens = NULL;
-        *output_rpn_tokens_count = 0;
-        error_string = get_rpn_error_str(rpn_error);
-        strncpy(output_error->message, error_string, MEVAL_ERROR_STRING_LEN);
-        output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
+    for (uint32_t i=0; i < ops_count; i++) {
+        DBPRINT("Bytecode[%u]: %u\n", i, output_compiled_expr->ops[i]);
     }
+    return true;
 }
 
-static double meval_internal_eval_tokens(LexToken* input_rpn_tokens, uint32_t input_rpn_tokens_count, bool support_variables, const MEvalVarArr variables, MEvalError* output_error) {
+/*
+ * 'eval_bytecode' jumps straight from one instruction to the next through a
+ *   table of label addresses (GCC/Clang "labels as values"), otherwise it falls
+ *   back to a switch. Each 'EVAL_TARGET' is both a label and a case.
+ */
+#if defined(__GNUC__)
+#define EVAL_USE_COMPUTED_GOTO 1
+#define EVAL_TARGET(label, opcode) label
+#define EVAL_DEFAULT_TARGET(label) label
+#define EVAL_DISPATCH() goto *dispatch_table[op = *ops++]
+#else
+#define EVAL_USE_COMPUTED_GOTO 0
+#define EVAL_TARGET(label, opcode) case opcode
+#define EVAL_DEFAULT_TARGET(label) default
+#define EVAL_DISPATCH() break
+#endif
 
-    const char* error_string = NULL;
+#define EVAL_JUMP() do { /* To the target in the next operands (see 'enum OPCODE') */ \
+        const uint32_t* target = operands; \
+        ops = compiled_expr->ops + target[0]; \
+        numbers = compiled_expr->numbers + target[1]; \
+        operands = compiled_expr->operands + target[2]; \
+    } while (0)
 
-    double output = 0;
-    enum EVAL_ERROR eval_error = EE_NONE;
-    eval_rpn_tokens(input_rpn_tokens, input_rpn_tokens_count, support_variables, variables.arr_ptr, variables.elements_count, &output, &eval_error);
-    if (eval_error != EE_NONE) {
-        output_error->type = MEVAL_PARSE_ERROR;
-        output_error->char_index = 0; // To be determined.
-        error_string = get_eval_error_str(eval_error);
-        strncpy(output_error->message, error_string, MEVAL_ERROR_STRING_LEN);
-        output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
-        return 0;
+#if EVAL_USE_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+static double eval_bytecode(const MEvalCompiledExpr* compiled_expr, const double* var_values, double* number_stack) {
+    /*
+     * 'var_values' is indexed by var_id, every variable must already be
+     *   resolved to a value by the caller.
+     * 'number_stack' must hold at least 'max_stack_depth' doubles. The bytecode
+     *   was validated when compiled, therefore no operand count checks are done here.
+     * Arithmetic, comparison and logic functions are done inline, only the
+     *   other functions are called through 'unary_fns'/'binary_fns'/'nary_fns'.
+     * Jumps are taken, so only the branch of 'if', '&' and '|' needed is evaluated.
+     */
+    const uint8_t* ops = compiled_expr->ops;
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    double* stack_top = number_stack - 1;
+    uint8_t op;
+#if EVAL_USE_COMPUTED_GOTO
+    static const void* const dispatch_table[OP_COUNT] = {
+        [OP_UNARY_FN ... OP_BINARY_FN-1] = &&op_fn,
+        [OP_BINARY_FN ... OP_END-1] = &&op_fn,
+        [OP_NUMBER] = &&op_number,
+        [OP_VAR] = &&op_var,
+        [OP_UNARY_FN + UFN_NEGATE] = &&op_negate,
+        [OP_BINARY_FN + BFN_ADD] = &&op_add,
+        [OP_BINARY_FN + BFN_SUB] = &&op_sub,
+        [OP_BINARY_FN + BFN_MUL] = &&op_mul,
+        [OP_BINARY_FN + BFN_DIV] = &&op_div,
+        [OP_BINARY_FN + BFN_EQUAL] = &&op_equal,
+        [OP_BINARY_FN + BFN_GREATER] = &&op_greater,
+        [OP_BINARY_FN + BFN_LESS] = &&op_less,
+        [OP_BINARY_FN + BFN_GREATER_EQUAL] = &&op_greater_equal,
+        [OP_BINARY_FN + BFN_LESS_EQUAL] = &&op_less_equal,
+        [OP_BINARY_FN + BFN_AND] = &&op_and,
+        [OP_BINARY_FN + BFN_OR] = &&op_or,
+        [OP_END] = &&op_end,
+        [OP_USER_UNARY_FN] = &&op_user_unary_fn,
+        [OP_USER_BINARY_FN] = &&op_user_binary_fn,
+        [OP_USER_NARY_FN] = &&op_user_nary_fn,
+        [OP_JUMP_IF_FALSE] = &&op_jump_if_false,
+        [OP_JUMP] = &&op_jump,
+        [OP_SKIP_IF_FALSE] = &&op_skip_if_false,
+        [OP_SKIP_IF_TRUE] = &&op_skip_if_true,
+        [OP_SELECT] = &&op_select,
+    };
+    EVAL_DISPATCH();
+#else
+    for (;;) switch (op = *ops++) {
+#endif
+    EVAL_TARGET(op_number, OP_NUMBER):
+        *++stack_top = *numbers++;
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_var, OP_VAR):
+        *++stack_top = var_values[*operands++];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_negate, OP_UNARY_FN + UFN_NEGATE):
+        *stack_top = -*stack_top;
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_add, OP_BINARY_FN + BFN_ADD):
+        stack_top--;
+        stack_top[0] = stack_top[0] + stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_sub, OP_BINARY_FN + BFN_SUB):
+        stack_top--;
+        stack_top[0] = stack_top[0] - stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_mul, OP_BINARY_FN + BFN_MUL):
+        stack_top--;
+        stack_top[0] = stack_top[0] * stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_div, OP_BINARY_FN + BFN_DIV):
+        stack_top--;
+        stack_top[0] = stack_top[0] / stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_equal, OP_BINARY_FN + BFN_EQUAL):
+        stack_top--;
+        stack_top[0] = stack_top[0] == stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_greater, OP_BINARY_FN + BFN_GREATER):
+        stack_top--;
+        stack_top[0] = stack_top[0] > stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_less, OP_BINARY_FN + BFN_LESS):
+        stack_top--;
+        stack_top[0] = stack_top[0] < stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_greater_equal, OP_BINARY_FN + BFN_GREATER_EQUAL):
+        stack_top--;
+        stack_top[0] = stack_top[0] >= stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_less_equal, OP_BINARY_FN + BFN_LESS_EQUAL):
+        stack_top--;
+        stack_top[0] = stack_top[0] <= stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_and, OP_BINARY_FN + BFN_AND):
+        stack_top--;
+        stack_top[0] = stack_top[0] && stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_or, OP_BINARY_FN + BFN_OR):
+        stack_top--;
+        stack_top[0] = stack_top[0] || stack_top[1];
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_end, OP_END):
+        // TODO: Go through every element, and make sure that a binary function does not have another binary function adjacent (directly next to it).
+        //    Unary functions can be ignored, because unary functions can have parameters from the left or the right, or may even have another unary function next to it.
+        return number_stack[0];
+    EVAL_TARGET(op_user_unary_fn, OP_USER_UNARY_FN): {
+        const RegisteredFn* fn = &compiled_expr->registry->fns[*operands++];
+        *stack_top = fn->fnptr.unary(fn->userdata, *stack_top);
+        EVAL_DISPATCH();
     }
-    DBPRINT("Eval Error: %d\n", eval_error);
-    return output;
+    EVAL_TARGET(op_user_binary_fn, OP_USER_BINARY_FN): {
+        const RegisteredFn* fn = &compiled_expr->registry->fns[*operands++];
+        stack_top--;
+        stack_top[0] = fn->fnptr.binary(fn->userdata, stack_top[0], stack_top[1]);
+        EVAL_DISPATCH();
+    }
+    EVAL_TARGET(op_user_nary_fn, OP_USER_NARY_FN): {
+        const RegisteredFn* fn = &compiled_expr->registry->fns[*operands++];
+        stack_top -= fn->args_count - 1; // The arguments are read straight off the stack.
+        stack_top[0] = fn->fnptr.nary(fn->userdata, stack_top, fn->args_count);
+        EVAL_DISPATCH();
+    }
+    EVAL_TARGET(op_jump_if_false, OP_JUMP_IF_FALSE):
+        if (*stack_top-- == 0) {
+            EVAL_JUMP();
+        } else {
+            operands += JUMP_OPERANDS_COUNT;
+        }
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_jump, OP_JUMP):
+        EVAL_JUMP();
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_skip_if_false, OP_SKIP_IF_FALSE):
+        if (*stack_top == 0) {
+            *stack_top = 0;
+            EVAL_JUMP();
+        } else {
+            operands += JUMP_OPERANDS_COUNT;
+        }
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_skip_if_true, OP_SKIP_IF_TRUE):
+        if (*stack_top != 0) {
+            *stack_top = 1;
+            EVAL_JUMP();
+        } else {
+            operands += JUMP_OPERANDS_COUNT;
+        }
+        EVAL_DISPATCH();
+    EVAL_TARGET(op_select, OP_SELECT): // Only reached after 'b', OP_JUMP_IF_FALSE already popped the condition.
+        EVAL_DISPATCH();
+    EVAL_DEFAULT_TARGET(op_fn):
+        if (op < OP_BINARY_FN) {
+            *stack_top = unary_fns[op - OP_UNARY_FN].fnptr(*stack_top);
+        } else if (op < OP_NARY_FN) {
+            stack_top--;
+            stack_top[0] = binary_fns[op - OP_BINARY_FN].fnptr(stack_top[0], stack_top[1]);
+        } else {
+            const uint32_t args_count = *operands++;
+            stack_top -= args_count - 1; // The arguments are read straight off the stack.
+            stack_top[0] = nary_fns[op - OP_NARY_FN].fnptr(stack_top, args_count);
+        }
+        EVAL_DISPATCH();
+#if !EVAL_USE_COMPUTED_GOTO
+    }
+#endif
 }
+#if EVAL_USE_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
 
-static double meval_internal_run(const char* input_string, bool support_variables, const MEvalVarArr variables, MEvalError* output_error) {
-
-    // Reset the error object to a known state.
-    output_error->type = MEVAL_NO_ERROR;
-    output_error->char_index = 0;
-    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+static inline double eval_fn_op(uint8_t op, double a, double b) {
+    /* Applies the unary or binary function instruction 'op' to its operands ('b' is unused by unary functions), arithmetic inline as in 'eval_bytecode' */
+    switch (op) {
+        case OP_UNARY_FN + UFN_NEGATE:
+            return -a;
+        case OP_BINARY_FN + BFN_ADD:
+            return a + b;
+        case OP_BINARY_FN + BFN_SUB:
+            return a - b;
+        case OP_BINARY_FN + BFN_MUL:
+            return a * b;
+        case OP_BINARY_FN + BFN_DIV:
+            return a / b;
+        default:
+            if (op < OP_BINARY_FN) {
+                return unary_fns[op - OP_UNARY_FN].fnptr(a);
+            }
+            return binary_fns[op - OP_BINARY_FN].fnptr(a, b);
+    }
+}
 
-    MEvalVarArr empty_variable_array = {0};
+static void eval_unary_fn_block(enum UNARY_FUNCTION_NAMES fn, double* restrict values, size_t values_count) {
+    /* Applies 'fn' to every element of 'values', in place. Cheap functions are written out so the loop can be vectorised */
+    switch (fn) {
+        case UFN_NEGATE:
+            for (size_t i=0; i < values_count; i++) { values[i] = -values[i]; }
+            break;
+        default:
+            for (size_t i=0; i < values_count; i++) { values[i] = unary_fns[fn].fnptr(values[i]); }
+            break;
+    }
+}
 
-    const MEvalVarArr final_variables = support_variables ? variables : empty_variable_array;
+static void eval_binary_fn_block(enum BINARY_FUNCTION_NAMES fn, double* restrict values_a, const double* restrict values_b, size_t values_count) {
+    /* values_a[i] = fn(values_a[i], values_b[i]). Cheap functions are written out so the loop can be vectorised */
+    switch (fn) {
+        case BFN_ADD:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] + values_b[i]; }
+            break;
+        case BFN_SUB:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] - values_b[i]; }
+            break;
+        case BFN_MUL:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] * values_b[i]; }
+            break;
+        case BFN_DIV:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] / values_b[i]; }
+            break;
+        case BFN_EQUAL:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] == values_b[i]; }
+            break;
+        case BFN_GREATER:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] > values_b[i]; }
+            break;
+        case BFN_LESS:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] < values_b[i]; }
+            break;
+        case BFN_GREATER_EQUAL:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] >= values_b[i]; }
+            break;
+        case BFN_LESS_EQUAL:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = values_a[i] <= values_b[i]; }
+            break;
+        case BFN_AND: // Same as fn_and, without the short-circuit that stops vectorisation.
+            for (size_t i=0; i < values_count; i++) { values_a[i] = (values_a[i] != 0) & (values_b[i] != 0); }
+            break;
+        case BFN_OR:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = (values_a[i] != 0) | (values_b[i] != 0); }
+            break;
+        default:
+            for (size_t i=0; i < values_count; i++) { values_a[i] = binary_fns[fn].fnptr(values_a[i], values_b[i]); }
+            break;
+    }
+}
 
-    LexToken* rpn_tokens = NULL;
-    uint32_t rpn_tokens_count = 0;
-    meval_internal_compile_expr(input_string, support_variables, final_variables, &rpn_tokens, &rpn_tokens_count, output_error);
-    if (output_error->type != MEVAL_NO_ERROR) {
-        if (rpn_tokens_count != 0) {
-            MEVAL_FREE(rpn_tokens);
+static void eval_nary_fn_block(enum NARY_FUNCTION_NAMES fn, double* restrict values, uint32_t args_count, size_t values_count) {
+    /*
+     * 'values' holds 'args_count' blocks of EVAL_BATCH_BLOCK_LEN doubles, one
+     *   per argument. values[i] = fn(first block[i], second block[i], ...).
+     *   min and max are reduced a block at a time, so the loops can be vectorised.
+     */
+    switch (fn) {
+        case NFN_MIN:
+            for (uint32_t arg_index=1; arg_index < args_count; arg_index++) {
+                const double* restrict arg = values + (size_t)arg_index*EVAL_BATCH_BLOCK_LEN;
+                for (size_t i=0; i < values_count; i++) { values[i] = fmin(values[i], arg[i]); }
+            }
+            break;
+        case NFN_MAX:
+            for (uint32_t arg_index=1; arg_index < args_count; arg_index++) {
+                const double* restrict arg = values + (size_t)arg_index*EVAL_BATCH_BLOCK_LEN;
+                for (size_t i=0; i < values_count; i++) { values[i] = fmax(values[i], arg[i]); }
+            }
+            break;
+        case NFN_FMA:
+            for (size_t i=0; i < values_count; i++) { values[i] = fma(values[i], values[EVAL_BATCH_BLOCK_LEN + i], values[2*EVAL_BATCH_BLOCK_LEN + i]); }
+            break;
+        default: {
+            double args[CALL_MAX_ARGS_COUNT];
+            for (size_t i=0; i < values_count; i++) {
+                for (uint32_t arg_index=0; arg_index < args_count; arg_index++) { args[arg_index] = values[(size_t)arg_index*EVAL_BATCH_BLOCK_LEN + i]; }
+                values[i] = nary_fns[fn].fnptr(args, args_count);
+            }
+            break;
         }
-        return 0;
     }
+}
 
-    double output = meval_internal_eval_tokens(rpn_tokens, rpn_tokens_count, support_variables, variables, output_error);
-    MEVAL_FREE(rpn_tokens);
-    if (output_error->type != MEVAL_NO_ERROR) {
-        return 0;
+static void eval_bytecode_block(const MEvalCompiledExpr* compiled_expr, const double* const* columns, size_t row_start, size_t rows_count, double* block_stack, double* output) {
+    /*
+     * Same as 'eval_bytecode', but each instruction is applied to 'rows_count'
+     *   (at most EVAL_BATCH_BLOCK_LEN) rows at a time.
+     * 'columns' is indexed by bound schema slot, 'block_stack' must hold
+     *   'max_stack_depth' blocks of EVAL_BATCH_BLOCK_LEN doubles.
+     */
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    double* stack_top = block_stack - EVAL_BATCH_BLOCK_LEN;
+    uint64_t jumping_ifs = 0; // Bit per open 'if', innermost last, set when it jumped (popping its condition) for every row.
+    uint32_t open_ifs_count = 0;
+    for (uint32_t ops_index = 0; ops_index < compiled_expr->ops_count; ops_index++) {
+        const uint8_t op = compiled_expr->ops[ops_index];
+        if (op == OP_NUMBER) {
+            stack_top += EVAL_BATCH_BLOCK_LEN;
+            const double number = *numbers++;
+            for (size_t i=0; i < rows_count; i++) { stack_top[i] = number; }
+        } else if (op == OP_VAR) {
+            stack_top += EVAL_BATCH_BLOCK_LEN;
+            memcpy(stack_top, columns[compiled_expr->var_slots[*operands++]] + row_start, rows_count*sizeof(double));
+        } else if (op < OP_BINARY_FN) {
+            eval_unary_fn_block((enum UNARY_FUNCTION_NAMES)(op - OP_UNARY_FN), stack_top, rows_count);
+        } else if (op < OP_NARY_FN) {
+            stack_top -= EVAL_BATCH_BLOCK_LEN;
+            eval_binary_fn_block((enum BINARY_FUNCTION_NAMES)(op - OP_BINARY_FN), stack_top, stack_top + EVAL_BATCH_BLOCK_LEN, rows_count);
+        } else if (op < OP_END) {
+            const uint32_t args_count = *operands++;
+            stack_top -= (size_t)(args_count - 1)*EVAL_BATCH_BLOCK_LEN;
+            eval_nary_fn_block((enum NARY_FUNCTION_NAMES)(op - OP_NARY_FN), stack_top, args_count, rows_count);
+        } else if (op == OP_SELECT) {
+            open_ifs_count--;
+            if (open_ifs_count >= EVAL_BATCH_MAX_JUMPING_IFS || (jumping_ifs & (uint64_t)1 << open_ifs_count) == 0) { // Both branches were evaluated.
+                stack_top -= 2*EVAL_BATCH_BLOCK_LEN;
+                const double* restrict values_a = stack_top + EVAL_BATCH_BLOCK_LEN;
+                const double* restrict values_b = stack_top + 2*EVAL_BATCH_BLOCK_LEN;
+                for (size_t i=0; i < rows_count; i++) { stack_top[i] = stack_top[i] != 0 ? values_a[i] : values_b[i]; }
+            }
+        } else if (op >= OP_JUMP_IF_FALSE) {
+            /*
+             * A jump is only taken when it would be for every row, otherwise
+             *   both branches are evaluated, for OP_SELECT or the '&'/'|' to
+             *   combine row by row.
+             */
+            const uint32_t* target = operands;
+            operands += JUMP_OPERANDS_COUNT;
+            bool is_jump_taken = false;
+            if (op == OP_JUMP) {
+                is_jump_taken = open_ifs_count <= EVAL_BATCH_MAX_JUMPING_IFS && (jumping_ifs & (uint64_t)1 << (open_ifs_count-1)) != 0;
+                open_ifs_count -= is_jump_taken; // Its OP_SELECT is jumped over.
+            } else {
+                const bool jumps_if_true = op == OP_SKIP_IF_TRUE;
+                size_t jumping_rows_count = 0;
+                for (size_t i=0; i < rows_count; i++) { jumping_rows_count += (stack_top[i] != 0) == jumps_if_true; }
+                if (op == OP_JUMP_IF_FALSE) {
+                    const bool is_uniform = (jumping_rows_count == 0 || jumping_rows_count == rows_count) && open_ifs_count < EVAL_BATCH_MAX_JUMPING_IFS;
+                    if (open_ifs_count < EVAL_BATCH_MAX_JUMPING_IFS) {
+                        jumping_ifs = (jumping_ifs & ~((uint64_t)1 << open_ifs_count)) | (uint64_t)is_uniform << open_ifs_count;
+                    }
+                    open_ifs_count++;
+                    if (is_uniform) {
+                        stack_top -= EVAL_BATCH_BLOCK_LEN;
+                        is_jump_taken = jumping_rows_count != 0;
+                    }
+                } else if (jumping_rows_count == rows_count) {
+                    for (size_t i=0; i < rows_count; i++) { stack_top[i] = jumps_if_true; }
+                    is_jump_taken = true;
+                }
+            }
+            if (is_jump_taken) {
+                ops_index = target[0] - 1;
+                numbers = compiled_expr->numbers + target[1];
+                operands = compiled_expr->operands + target[2];
+            }
+        } else { // Registered functions, called one row at a time.
+            const RegisteredFn* fn = &compiled_expr->registry->fns[*operands++];
+            stack_top -= (size_t)(fn->args_count - 1)*EVAL_BATCH_BLOCK_LEN;
+            double args[CALL_MAX_ARGS_COUNT];
+            for (size_t i=0; i < rows_count; i++) {
+                for (uint32_t arg_index=0; arg_index < fn->args_count; arg_index++) {
+                    args[arg_index] = stack_top[arg_index*EVAL_BATCH_BLOCK_LEN + i];
+                }
+                stack_top[i] = call_registered_fn(fn, args);
+            }
+        }
     }
-    
-    return output;
+    memcpy(output + row_start, block_stack, rows_count*sizeof(double));
 }
 
-double meval(const char* input_string, MEvalError* error) {
-    MEvalVarArr empty_variables = {0};
-    return meval_internal_run(input_string, false, empty_variables, error);
+#if JIT_SUPPORTED
+/*
+ * x86-64 (System V ABI) code generation, SSE2 only.
+ * The generated function is 'double fn(const double* values)'. The values
+ *   pointer is kept in rbx, the top of the number stack in xmm0, and the rest
+ *   of the number stack in the functions stack frame, at [rsp + 8*index].
+ *   Functions without an inline encoding are called through their function
+ *   pointer, which only needs the stack frame to survive the call.
+ */
+#define JIT_MAX_BYTES_PER_OP 64
+
+typedef struct {
+    uint8_t* code;
+    size_t code_count;
+} JitBuffer;
+
+static void jit_emit(JitBuffer* buffer, const uint8_t* bytes, size_t bytes_count) {
+    memcpy(buffer->code + buffer->code_count, bytes, bytes_count);
+    buffer->code_count += bytes_count;
 }
 
-double meval_var(const char* input_string, const MEvalVarArr variables, MEvalError* error) {
-    return meval_internal_run(input_string, true, variables, error);
+static void jit_emit_u32(JitBuffer* buffer, uint32_t value) {
+    jit_emit(buffer, (const uint8_t*)&value, sizeof(value)); // x86 is little endian, as is the encoding.
 }
 
-MEvalCompiledExpr* meval_var_compile(const char* input_string, MEvalError* output_error) {
-    // Reset the error object to a known state.
-    output_error->type = MEVAL_NO_ERROR;
-    output_error->char_index = 0;
-    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+static void jit_emit_mov_rax_u64(JitBuffer* buffer, uint64_t value) {
+    jit_emit(buffer, (const uint8_t[]){0x48, 0xB8}, 2); // mov rax, imm64
+    jit_emit(buffer, (const uint8_t*)&value, sizeof(value));
+}
 
-    MEvalVarArr empty_variable_array = {0};
+static void jit_emit_load_number(JitBuffer* buffer, uint8_t movq_xmm_rax_modrm, double number) {
+    /* movq xmmN, rax. 0xC0 for xmm0, 0xC8 for xmm1 */
+    uint64_t bits = 0;
+    memcpy(&bits, &number, sizeof(bits));
+    jit_emit_mov_rax_u64(buffer, bits);
+    jit_emit(buffer, (const uint8_t[]){0x66, 0x48, 0x0F, 0x6E, movq_xmm_rax_modrm}, 5);
+}
 
-    MEvalCompiledExpr* compiled_expr = MEVAL_MALLOC(sizeof(MEvalCompiledExpr));
-    if (compiled_expr == NULL) {
-        output_error->type = MEVAL_PACKAGING_ERROR;
-        output_error->char_index = 0;
-        snprintf(output_error->message, MEVAL_ERROR_STRING_LEN, "Heap allocation failed");
-        return NULL;
-    }
-    meval_internal_compile_expr(input_string, true, empty_variable_array, &compiled_expr->tokens, &compiled_expr->tokens_count, output_error);
-    return compiled_expr;
+static void jit_emit_stack_op(JitBuffer* buffer, uint8_t prefix, uint8_t opcode, uint8_t modrm, uint32_t stack_index) {
+    /* '<op> xmmN, [rsp + 8*stack_index]' (or the store form), 'modrm' picks xmmN */
+    jit_emit(buffer, (const uint8_t[]){prefix, 0x0F, opcode, modrm, 0x24}, 5);
+    jit_emit_u32(buffer, stack_index*sizeof(double));
 }
 
-double meval_var_eval_cexpr(const MEvalCompiledExpr* compiled_expr, const MEvalVarArr variables, MEvalError* output_error) {
-    // Reset the error object to a known state.
-    output_error->type = MEVAL_NO_ERROR;
-    output_error->char_index = 0;
-    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+static void jit_emit_call(JitBuffer* buffer, const void* fnptr_storage) {
+    /* 'fnptr_storage' points to the function pointer, ISO C has no function to object pointer cast */
+    uint64_t address = 0;
+    memcpy(&address, fnptr_storage, sizeof(address));
+    jit_emit_mov_rax_u64(buffer, address);
+    jit_emit(buffer, (const uint8_t[]){0xFF, 0xD0}, 2); // call rax
+}
 
-    if (compiled_expr == NULL) {
-        output_error->type = MEVAL_PACKAGING_ERROR;
-        output_error->char_index = 0;
-        snprintf(output_error->message, MEVAL_ERROR_STRING_LEN, "Compiled expression is empty");
-        return 0;
-    }
+static void jit_emit_bool_mask_to_number(JitBuffer* buffer) {
+    /* Turns an all-ones/all-zero mask in xmm0 into 1.0/0.0 */
+    jit_emit_load_number(buffer, 0xC8, 1.0);
+    jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x54, 0xC1}, 4); // andpd xmm0, xmm1
+}
 
-    double output = meval_internal_eval_tokens(compiled_expr->tokens, compiled_expr->tokens_count, true, variables, output_error);
-    if (output_error->type != MEVAL_NO_ERROR) {
-        return 0;
-    }
-    return output;
+static void jit_emit_jump(JitBuffer* buffer, const uint8_t* opcode, size_t opcode_count, uint32_t target_ops_index, uint32_t* jump_positions, uint32_t* jump_targets, uint32_t* jumps_count) {
+    /* A jump with a rel32 to the code of instruction 'target_ops_index', filled in once every instruction is emitted */
+    jit_emit(buffer, opcode, opcode_count);
+    jump_positions[*jumps_count] = buffer->code_count;
+    jump_targets[(*jumps_count)++] = target_ops_index;
+    jit_emit_u32(buffer, 0);
 }
 
-void meval_free_compiled_expr(MEvalCompiledExpr** compiled_expr) {
-    if ((*compiled_expr) != NULL) {
-        if ((*compiled_expr)->tokens != NULL) {
-            MEVAL_FREE((*compiled_expr)->tokens);
-            (*compiled_expr)->tokens = NULL;
-            (*compiled_expr)->tokens_count = 0;
+static bool gen_jit_code(const MEvalCompiledExpr* compiled_expr, JitBuffer* buffer) {
+    /*
+     * Returns false if the bytecode contains something that cannot be compiled, or on a failed allocation.
+     * Jumps are taken as in 'eval_bytecode'. After OP_JUMP_IF_FALSE and
+     *   OP_JUMP the stack is one value shallower, as at the start of the next branch.
+     */
+    const uint32_t frame_size = (compiled_expr->max_stack_depth*sizeof(double) + 15) & ~15u; // Keeps rsp 16 byte aligned for calls, after 'push rbx'.
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    uint32_t stack_depth = 0;
+    uint32_t* op_offsets = MEVAL_MALLOC((3*(size_t)compiled_expr->ops_count + 1)*sizeof(uint32_t)); // Code offset of every instruction, and of the end.
+    if (op_offsets == NULL) {
+        return false;
+    }
+    uint32_t* jump_positions = op_offsets + compiled_expr->ops_count + 1;
+    uint32_t* jump_targets = jump_positions + compiled_expr->ops_count;
+    uint32_t jumps_count = 0;
+    jit_emit(buffer, (const uint8_t[]){0x53, 0x48, 0x89, 0xFB}, 4); // push rbx; mov rbx, rdi
+    jit_emit(buffer, (const uint8_t[]){0x48, 0x81, 0xEC}, 3); // sub rsp, imm32
+    jit_emit_u32(buffer, frame_size);
+    for (uint32_t ops_index = 0; ops_index < compiled_expr->ops_count; ops_index++) {
+        const uint8_t op = compiled_expr->ops[ops_index];
+        op_offsets[ops_index] = buffer->code_count;
+        if (op == OP_SELECT) {
+            // Only reached after 'b', which is already in xmm0.
+        } else if (is_jump_op(op)) {
+            const uint32_t target_ops_index = operands[0];
+            operands += JUMP_OPERANDS_COUNT;
+            if (op != OP_JUMP) {
+                jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x57, 0xC9}, 4); // xorpd xmm1, xmm1
+                jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x2E, 0xC1}, 4); // ucomisd xmm0, xmm1 (ZF and PF are set for NaN, which is true)
+            }
+            if (op == OP_JUMP_IF_FALSE) {
+                stack_depth--;
+                if (stack_depth > 0) {
+                    jit_emit_stack_op(buffer, 0xF2, 0x10, 0x84, stack_depth-1); // movsd xmm0, [rsp+disp32] (keeps the flags)
+                }
+                jit_emit(buffer, (const uint8_t[]){0x7A, 0x06}, 2); // jp past the je
+                jit_emit_jump(buffer, (const uint8_t[]){0x0F, 0x84}, 2, target_ops_index, jump_positions, jump_targets, &jumps_count); // je rel32
+            } else if (op == OP_JUMP) {
+                jit_emit_jump(buffer, (const uint8_t[]){0xE9}, 1, target_ops_index, jump_positions, jump_targets, &jumps_count); // jmp rel32
+                stack_depth--;
+            } else if (op == OP_SKIP_IF_FALSE) {
+                jit_emit(buffer, (const uint8_t[]){0x7A, 0x0B, 0x75, 0x09}, 4); // jp/jne past the skip
+                jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x57, 0xC0}, 4); // xorpd xmm0, xmm0
+                jit_emit_jump(buffer, (const uint8_t[]){0xE9}, 1, target_ops_index, jump_positions, jump_targets, &jumps_count); // jmp rel32
+            } else {
+                jit_emit(buffer, (const uint8_t[]){0x7A, 0x02, 0x74, 0x14}, 4); // jp to the skip, je past it
+                jit_emit_load_number(buffer, 0xC0, 1.0);
+                jit_emit_jump(buffer, (const uint8_t[]){0xE9}, 1, target_ops_index, jump_positions, jump_targets, &jumps_count); // jmp rel32
+            }
+        } else if (op == OP_NUMBER || op == OP_VAR) {
+            if (stack_depth > 0) {
+                jit_emit_stack_op(buffer, 0xF2, 0x11, 0x84, stack_depth-1); // movsd [rsp+disp32], xmm0
+            }
+            if (op == OP_NUMBER) {
+                jit_emit_load_number(buffer, 0xC0, *numbers++);
+            } else {
+                jit_emit(buffer, (const uint8_t[]){0xF2, 0x0F, 0x10, 0x83}, 4); // movsd xmm0, [rbx+disp32]
+                jit_emit_u32(buffer, compiled_expr->var_slots[*operands++]*sizeof(double));
+            }
+            stack_depth++;
+        } else if (op == OP_UNARY_FN + UFN_NEGATE) {
+            jit_emit_load_number(buffer, 0xC8, -0.0);
+            jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x57, 0xC1}, 4); // xorpd xmm0, xmm1
+        } else if (op >= OP_UNARY_FN && op < OP_BINARY_FN) {
+            jit_emit_call(buffer, &unary_fns[op - OP_UNARY_FN].fnptr);
+        } else if (op >= OP_NARY_FN && op < OP_END) {
+            // The last argument is in xmm0, spill it so every argument is on the stack for 'fnptr(args, args_count)'.
+            const uint32_t args_count = *operands++;
+            jit_emit_stack_op(buffer, 0xF2, 0x11, 0x84, stack_depth-1); // movsd [rsp+disp32], xmm0
+            jit_emit(buffer, (const uint8_t[]){0x48, 0x8D, 0xBC, 0x24}, 4); // lea rdi, [rsp+disp32]
+            jit_emit_u32(buffer, (stack_depth - args_count)*sizeof(double));
+            jit_emit(buffer, (const uint8_t[]){0xBE}, 1); // mov esi, imm32
+            jit_emit_u32(buffer, args_count);
+            jit_emit_call(buffer, &nary_fns[op - OP_NARY_FN].fnptr);
+            stack_depth -= args_count - 1;
+        } else if (op >= OP_BINARY_FN && op < OP_END) {
+            // a is at stack index 'stack_depth-2', b is in xmm0.
+            const uint32_t a_index = stack_depth-2;
+            switch (op - OP_BINARY_FN) {
+                case BFN_ADD:
+                    jit_emit_stack_op(buffer, 0xF2, 0x58, 0x84, a_index); // addsd xmm0, [a]
+                    break;
+                case BFN_MUL:
+                    jit_emit_stack_op(buffer, 0xF2, 0x59, 0x84, a_index); // mulsd xmm0, [a]
+                    break;
+                case BFN_SUB:
+                case BFN_DIV:
+                    jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x28, 0xC8}, 4); // movapd xmm1, xmm0
+                    jit_emit_stack_op(buffer, 0xF2, 0x10, 0x84, a_index); // movsd xmm0, [a]
+                    jit_emit(buffer, (const uint8_t[]){0xF2, 0x0F, op - OP_BINARY_FN == BFN_SUB ? 0x5C : 0x5E, 0xC1}, 4); // subsd/divsd xmm0, xmm1
+                    break;
+                case BFN_EQUAL:
+                case BFN_LESS:
+                case BFN_LESS_EQUAL: {
+                    const uint8_t predicate = op - OP_BINARY_FN == BFN_EQUAL ? 0 : (op - OP_BINARY_FN == BFN_LESS ? 1 : 2);
+                    jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x28, 0xC8}, 4); // movapd xmm1, xmm0
+                    jit_emit_stack_op(buffer, 0xF2, 0x10, 0x84, a_index); // movsd xmm0, [a]
+                    jit_emit(buffer, (const uint8_t[]){0xF2, 0x0F, 0xC2, 0xC1, predicate}, 5); // cmpsd xmm0, xmm1, predicate (a ? b)
+                    jit_emit_bool_mask_to_number(buffer);
+                    break;
+                }
+                case BFN_GREATER:
+                case BFN_GREATER_EQUAL: { // a > b is b < a
+                    const uint8_t predicate = op - OP_BINARY_FN == BFN_GREATER ? 1 : 2;
+                    jit_emit_stack_op(buffer, 0xF2, 0x10, 0x8C, a_index); // movsd xmm1, [a]
+                    jit_emit(buffer, (const uint8_t[]){0xF2, 0x0F, 0xC2, 0xC1, predicate}, 5); // cmpsd xmm0, xmm1, predicate (b ? a)
+                    jit_emit_bool_mask_to_number(buffer);
+                    break;
+                }
+                case BFN_AND:
+                case BFN_OR:
+                    jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x57, 0xC9}, 4); // xorpd xmm1, xmm1
+                    jit_emit(buffer, (const uint8_t[]){0xF2, 0x0F, 0xC2, 0xC1, 4}, 5); // cmpsd xmm0, xmm1, NEQ (NaN is true, as in C)
+                    jit_emit_stack_op(buffer, 0xF2, 0x10, 0x94, a_index); // movsd xmm2, [a]
+                    jit_emit(buffer, (const uint8_t[]){0xF2, 0x0F, 0xC2, 0xD1, 4}, 5); // cmpsd xmm2, xmm1, NEQ
+                    jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, op - OP_BINARY_FN == BFN_AND ? 0x54 : 0x56, 0xC2}, 4); // andpd/orpd xmm0, xmm2
+                    jit_emit_bool_mask_to_number(buffer);
+                    break;
+                default:
+                    jit_emit(buffer, (const uint8_t[]){0x66, 0x0F, 0x28, 0xC8}, 4); // movapd xmm1, xmm0
+                    jit_emit_stack_op(buffer, 0xF2, 0x10, 0x84, a_index); // movsd xmm0, [a]
+                    jit_emit_call(buffer, &binary_fns[op - OP_BINARY_FN].fnptr);
+                    break;
+            }
+            stack_depth--;
+        } else {
+            MEVAL_FREE(op_offsets);
+            return false;
         }
-        MEVAL_FREE(*compiled_expr);
-        *compiled_expr = NULL;
     }
+    op_offsets[compiled_expr->ops_count] = buffer->code_count;
+    for (uint32_t i=0; i < jumps_count; i++) {
+        const uint32_t rel = op_offsets[jump_targets[i]] - (jump_positions[i] + sizeof(uint32_t));
+        memcpy(buffer->code + jump_positions[i], &rel, sizeof(rel));
+    }
+    MEVAL_FREE(op_offsets);
+    jit_emit(buffer, (const uint8_t[]){0x48, 0x81, 0xC4}, 3); // add rsp, imm32
+    jit_emit_u32(buffer, frame_size);
+    jit_emit(buffer, (const uint8_t[]){0x5B, 0xC3}, 2); // pop rbx; ret
+    return true;
 }
+#endif
 
-void meval_free_variable_arr(MEvalVarArr *variables_array) {
-    if (variables_array->arr_ptr != NULL) {
-        MEVAL_FREE(variables_array->arr_ptr);
-        variables_array->arr_ptr = NULL;
+static void free_jit_code(MEvalCompiledExpr* compiled_expr) {
+#if JIT_SUPPORTED
+    if (compiled_expr->jit_code != NULL) {
+        munmap(compiled_expr->jit_code, compiled_expr->jit_code_size);
+    }
+#endif
+    compiled_expr->jit_fn = NULL;
+    compiled_expr->jit_code = NULL;
+    compiled_expr->jit_code_size = 0;
+}
+
+static void* arena_alloc(void* ctx, size_t size) {
+    MEvalArena* arena = ctx;
+    const size_t alignment = _Alignof(max_align_t);
+    const uintptr_t start = ((uintptr_t)(arena->buffer + arena->used) + alignment-1) & ~(uintptr_t)(alignment-1);
+    const size_t offset = start - (uintptr_t)arena->buffer;
+    if (offset > arena->capacity || size > arena->capacity - offset) {
+        return NULL;
+    }
+    arena->used = offset + size;
+    return arena->buffer + offset;
+}
+
+void meval_arena_init(MEvalArena* arena, void* buffer, size_t capacity) {
+    arena->buffer = buffer;
+    arena->capacity = buffer == NULL ? 0 : capacity;
+    arena->used = 0;
+}
+
+void meval_arena_reset(MEvalArena* arena) {
+    arena->used = 0;
+}
+
+MEvalAllocator meval_arena_allocator(MEvalArena* arena) {
+    MEvalAllocator allocator = {.alloc_fn=arena_alloc, .free_fn=NULL, .ctx=arena}; // Everything is released at once by 'meval_arena_reset'.
+    return allocator;
+}
+
+static void counters_to_stats(const uint64_t* counters, MEvalStats* output_stats) {
+    *output_stats = (MEvalStats){.compile_calls=counters[SC_COMPILE_CALLS], .eval_calls=counters[SC_EVAL_CALLS], .batch_rows=counters[SC_BATCH_ROWS],
+        .allocations_count=counters[SC_ALLOCATIONS], .bytes_allocated=counters[SC_BYTES_ALLOCATED], .tokens_count=counters[SC_TOKENS],
+        .var_lookups=counters[SC_VAR_LOOKUPS], .max_stack_depth=counters[SC_MAX_STACK_DEPTH]};
+    for (uint32_t phase = 0; phase < MEVAL_PHASE_COUNT; phase++) {
+        output_stats->phase_ns[phase] = counters[SC_PHASE_NS + phase];
+    }
+}
+
+bool meval_stats_get(MEvalStats* output_stats) {
+    uint64_t sums[SC_COUNT] = {0};
+#if STATS_ENABLED
+    pthread_mutex_lock(&stats_mutex);
+    add_stats_counters(sums, retired_stats);
+    for (const ThreadStats* stats = live_thread_stats; stats != NULL; stats = stats->next) {
+        uint64_t counters[SC_COUNT];
+        load_stats_counters(stats, counters);
+        add_stats_counters(sums, counters);
+    }
+    pthread_mutex_unlock(&stats_mutex);
+#endif
+    counters_to_stats(sums, output_stats);
+    return STATS_ENABLED;
+}
+
+bool meval_stats_get_thread(MEvalStats* output_stats) {
+    uint64_t counters[SC_COUNT] = {0};
+#if STATS_ENABLED
+    if (thread_stats != NULL) {
+        load_stats_counters(thread_stats, counters);
+    }
+#endif
+    counters_to_stats(counters, output_stats);
+    return STATS_ENABLED;
+}
+
+void meval_stats_reset(void) {
+#if STATS_ENABLED
+    pthread_mutex_lock(&stats_mutex);
+    memset(retired_stats, 0, sizeof(retired_stats));
+    for (ThreadStats* stats = live_thread_stats; stats != NULL; stats = stats->next) {
+        for (uint32_t i = 0; i < SC_COUNT; i++) {
+            atomic_store_explicit(&stats->counters[i], 0, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&stats_mutex);
+#endif
+}
+
+bool meval_append_variable(MEvalVarArr *variables_array, MEvalVar new_variable) {
+    if (variables_array->elements_count >= variables_array->capacity_elements) {
+        uint32_t new_capacity = MAX(variables_array->capacity_elements * 1.5, 3);
+        MEvalVar* tmp = MEVAL_REALLOCARRAY(variables_array->arr_ptr, new_capacity, sizeof(MEvalVar));
+        if (tmp == NULL) {
+            return false;
+        }
+        variables_array->arr_ptr = tmp;
+        variables_array->capacity_elements = new_capacity;
     }
+    variables_array->arr_ptr[variables_array->elements_count] = new_variable;
+    variables_array->elements_count++;
+    return true;
+}
+
+void free_variable_arr(MEvalVarArr *variables_array) {
+    MEVAL_FREE(variables_array->arr_ptr);
     variables_array->elements_count = 0;
     variables_array->capacity_elements = 0;
 }
+
+static bool grow_var_env(MEvalVarEnv* env, uint32_t capacity) {
+    /* Grows the arrays of 'env' to 'capacity' variables, and rebuilds its index to stay at most half full */
+    char (*names)[MEVAL_VAR_NAME_MAX_LEN] = MEVAL_REALLOCARRAY(env->names, capacity, MEVAL_VAR_NAME_MAX_LEN);
+    if (names == NULL) {
+        return false;
+    }
+    env->names = names;
+    double* values = MEVAL_REALLOCARRAY(env->values, capacity, sizeof(double));
+    if (values == NULL) {
+        return false;
+    }
+    env->values = values;
+    uint32_t index_count = 4;
+    while (index_count < capacity*2) {
+        index_count *= 2;
+    }
+    if (env->index != NULL && index_count <= env->index_mask+1) {
+        env->capacity = capacity;
+        return true;
+    }
+    uint32_t* index = MEVAL_MALLOC(index_count*sizeof(uint32_t));
+    if (index == NULL) {
+        return false; // The capacity stays within the old index.
+    }
+    memset(index, 0, index_count*sizeof(uint32_t));
+    for (uint32_t handle=0; handle < env->count; handle++) {
+        uint32_t table_index = hash_var_name(env->names[handle], strlen(env->names[handle])) & (index_count-1);
+        while (index[table_index] != 0) {
+            table_index = (table_index + 1) & (index_count-1);
+        }
+        index[table_index] = handle + 1;
+    }
+    MEVAL_FREE(env->index);
+    env->index = index;
+    env->index_mask = index_count-1;
+    env->capacity = capacity;
+    return true;
+}
+
+MEvalVarEnv* meval_var_env_create(uint32_t capacity, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalVarEnv* env = MEVAL_MALLOC(sizeof(MEvalVarEnv));
+    if (env == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(env, 0, sizeof(MEvalVarEnv));
+    if (!grow_var_env(env, MAX(capacity, 4))) {
+        meval_var_env_free(&env);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    return env;
+}
+
+uint32_t meval_var_env_set(MEvalVarEnv* env, const char* name, double value, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (env == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Variable environment is empty");
+        return MEVAL_VAR_ENV_NO_HANDLE;
+    }
+    const size_t name_char_count = name != NULL ? strlen(name) : 0;
+    if (name_char_count == 0 || name_char_count >= MEVAL_VAR_NAME_MAX_LEN) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Invalid variable name");
+        return MEVAL_VAR_ENV_NO_HANDLE;
+    }
+    uint32_t handle = find_env_var(env, name, name_char_count);
+    if (handle != MEVAL_VAR_ENV_NO_HANDLE) {
+        env->values[handle] = value;
+        return handle;
+    }
+    if (env->count >= env->capacity && (env->capacity > UINT32_MAX/4 || !grow_var_env(env, env->capacity*2))) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return MEVAL_VAR_ENV_NO_HANDLE;
+    }
+    handle = env->count++;
+    snprintf(env->names[handle], MEVAL_VAR_NAME_MAX_LEN, "%s", name);
+    env->values[handle] = value;
+    uint32_t table_index = hash_var_name(name, name_char_count) & env->index_mask;
+    while (env->index[table_index] != 0) {
+        table_index = (table_index + 1) & env->index_mask;
+    }
+    env->index[table_index] = handle + 1;
+    return handle;
+}
+
+uint32_t meval_var_env_find(const MEvalVarEnv* env, const char* name) {
+    if (env == NULL || name == NULL) {
+        return MEVAL_VAR_ENV_NO_HANDLE;
+    }
+    return find_env_var(env, name, strlen(name));
+}
+
+bool meval_var_env_get(const MEvalVarEnv* env, const char* name, double* output_value) {
+    uint32_t handle = meval_var_env_find(env, name);
+    if (handle == MEVAL_VAR_ENV_NO_HANDLE) {
+        return false;
+    }
+    *output_value = env->values[handle];
+    return true;
+}
+
+void meval_var_env_set_handle(MEvalVarEnv* env, uint32_t handle, double value) {
+    env->values[handle] = value;
+}
+
+double meval_var_env_get_handle(const MEvalVarEnv* env, uint32_t handle) {
+    return env->values[handle];
+}
+
+double* meval_var_env_values(MEvalVarEnv* env) {
+    return env->values;
+}
+
+uint32_t meval_var_env_count(const MEvalVarEnv* env) {
+    return env == NULL ? 0 : env->count;
+}
+
+const char* meval_var_env_name(const MEvalVarEnv* env, uint32_t handle) {
+    if (env == NULL || handle >= env->count) {
+        return NULL;
+    }
+    return env->names[handle];
+}
+
+void meval_var_env_free(MEvalVarEnv** env) {
+    if ((*env) != NULL) {
+        MEVAL_FREE((*env)->names);
+        MEVAL_FREE((*env)->values);
+        MEVAL_FREE((*env)->index);
+        MEVAL_FREE(*env);
+        *env = NULL;
+    }
+}
+
+static void meval_internal_compile_expr(const char* input_string, bool support_variables, const MEvalVarArr expected_variables, const MEvalVarEnv* expected_env, const MEvalRegistry* registry, const MEvalAllocator* allocator, LexToken** output_rpn_tokens, uint32_t *output_rpn_tokens_count, uint32_t* output_max_stack_depth, MEvalError* output_error) {
+    /*
+     * Note: 'expected_variables' maybe empty. If its empty, every
+     *    unrecognised/ambigious function is assumed to be a variable.
+     * Note: If 'expected_variables' is not empty (contains some varibles within
+     *    it), only unrecognised functions or identifiers that match the
+     *    expected variables name exactly are assumed as variables.
+     * Note: 'expected_env' may be NULL, otherwise its names are the expected
+     *    variables, and 'expected_variables' is ignored.
+     * Note: 'registry' may be NULL, otherwise its names are recognised too.
+     */
+    STATS_ADD(SC_COMPILE_CALLS, 1);
+    *output_rpn_tokens = NULL;
+    *output_rpn_tokens_count = 0;
+    *output_max_stack_depth = 0;
+    if (input_string == NULL) {
+        output_error->type = MEVAL_LEX_ERROR;
+        output_error->char_index = 0;
+        strncpy(output_error->message, "No Input Given", MEVAL_ERROR_STRING_LEN);
+        output_error->message[MEVAL_ERROR_STRING_LEN-1] = '\0';
+        return;
+    }
+    const uint32_t input_string_char_count = strlen(input_string);
+    if (input_string_char_count == 0) {
+        set_error(output_error, MEVAL_LEX_ERROR, 0, "Empty/Invalid Text Input");
+        return;
+    }
+    pthread_once(&identifier_trie_once, build_identifier_trie);
+    const IdentifierTrieNode* trie = registry != NULL ? registry->trie : identifier_trie;
+    RpnState rpn = {0};
+    rpn.tokens_capacity = input_string_char_count; // Every token takes up at least one char.
+    rpn.tokens = allocator_alloc(allocator, rpn.tokens_capacity*sizeof(LexToken));
+    rpn.allow_variables = support_variables;
+    rpn.registry = registry;
+    if (rpn.tokens == NULL || trie == NULL) {
+        allocator_free(allocator, rpn.tokens);
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_rpn_error_str(RPNE_FAILED_MEM_ALLOCATION));
+        return;
+    }
+    LexState lex = {.input_string=input_string, .input_string_char_count=input_string_char_count, .char_index=0,
+        .allow_variables=support_variables, .expected_variables=expected_variables, .expected_env=expected_env, .trie=trie, .registry=registry};
+
+    /*
+     * Tokens go straight from the lexer into the shunting-yard. Lex errors
+     *   take precedence over parse errors, so lexing carries on after a parse
+     *   error, until the first real lex error. The first LT_ERROR token is the
+     *   one reported, which may be one that alone is not an error (too many
+     *   '.' in a number, which is otherwise ignored).
+     */
+    LexToken token = {0};
+    uint32_t lex_tokens_count = 0;
+    bool error_occured = false;
+    LexToken first_error_token = {0};
+    bool found_error_token = false;
+    enum RPN_ERROR rpn_error = RPNE_NONE;
+    uint32_t rpn_error_char_index = 0;
+    STATS_PHASE_START(parse_start_ns);
+    while (!error_occured && lex_next_token(&lex, &token, &error_occured)) {
+        lex_tokens_count++;
+        if (token.type == LT_ERROR && !found_error_token) {
+            first_error_token = token;
+            found_error_token = true;
+        }
+        if (rpn_error == RPNE_NONE && !error_occured) {
+            add_rpn_token(&rpn, &token, &rpn_error);
+            if (rpn_error != RPNE_NONE) {
+                rpn_error_char_index = rpn.output_count != 0 ? rpn.tokens[rpn.output_count-1].char_index : 0;
+            }
+        }
+    }
+    DBPRINT("%d lex_tokens emitted, error_occured: %d\n", lex_tokens_count, error_occured);
+    STATS_ADD(SC_TOKENS, lex_tokens_count);
+    if (lex_tokens_count == 0) {
+        allocator_free(allocator, rpn.tokens);
+        set_error(output_error, MEVAL_LEX_ERROR, 0, "Empty/Invalid Text Input");
+        return;
+    }
+    if (error_occured) {
+        allocator_free(allocator, rpn.tokens);
+        set_error(output_error, MEVAL_LEX_ERROR, first_error_token.char_index, first_error_token.value.error_str);
+        return;
+    }
+    if (rpn_error != RPNE_NONE) {
+        DBPRINT("RPN Error occured (%d)\n", rpn_error);
+        allocator_free(allocator, rpn.tokens);
+        set_error(output_error, MEVAL_PARSE_ERROR, rpn_error_char_index, get_rpn_error_str(rpn_error));
+        return;
+    }
+    finish_rpn_tokens(&rpn, &rpn_error);
+    if (rpn_error != RPNE_NONE) {
+        allocator_free(allocator, rpn.tokens);
+        set_error(output_error, MEVAL_PARSE_ERROR, rpn.output_count != 0 ? rpn.tokens[rpn.output_count-1].char_index : 0, get_rpn_error_str(rpn_error));
+        return;
+    }
+    STATS_PHASE_END(MEVAL_PHASE_PARSE, parse_start_ns);
+    *output_rpn_tokens = rpn.tokens;
+    *output_rpn_tokens_count = rpn.output_count;
+    for (size_t i=0; i < (*output_rpn_tokens_count); i++) {
+        DBPRINT("RPN Token: ");
+        print_token((*output_rpn_tokens)[i]);
+    }
+    STATS_PHASE_START(fold_start_ns);
+    *output_rpn_tokens_count = fold_rpn_constants(*output_rpn_tokens, *output_rpn_tokens_count, support_variables, registry, allocator);
+    STATS_PHASE_END(MEVAL_PHASE_FOLD, fold_start_ns);
+    enum EVAL_ERROR eval_error = EE_NONE;
+    uint32_t error_token_index = 0;
+    STATS_PHASE_START(codegen_start_ns);
+    gen_stack_depth(*output_rpn_tokens, *output_rpn_tokens_count, support_variables, registry, output_max_stack_depth, &error_token_index, &eval_error);
+    STATS_PHASE_END(MEVAL_PHASE_CODEGEN, codegen_start_ns);
+    STATS_MAX(SC_MAX_STACK_DEPTH, *output_max_stack_depth);
+    if (eval_error != EE_NONE) {
+        DBPRINT("Stack depth Error occured (%d)\n", eval_error);
+        uint32_t char_index = (*output_rpn_tokens_count) != 0 ? (*output_rpn_tokens)[error_token_index].char_index : 0;
+        allocator_free(allocator, *output_rpn_tokens);
+        *output_rpn_tokens = NULL;
+        *output_rpn_tokens_count = 0;
+        set_error(output_error, MEVAL_PARSE_ERROR, char_index, get_eval_error_str(eval_error));
+    }
+}
+
+static bool gen_var_table(LexToken* rpn_tokens, uint32_t rpn_tokens_count, const MEvalAllocator* allocator, char (**output_var_names)[MEVAL_VAR_NAME_MAX_LEN], uint32_t* output_var_count) {
+    /*
+     * Collects every distinct variable name used by 'rpn_tokens' into
+     *   '*output_var_names', and rewrites each LT_VAR token to hold the index
+     *   of its name ('value.var_id') instead of the name itself.
+     * '*output_var_names' is sized for every LT_VAR token being distinct, so
+     *   it never needs to grow (allocators have no realloc).
+     * Returns false on a failed allocation.
+     */
+    *output_var_names = NULL;
+    *output_var_count = 0;
+    uint32_t var_tokens_count = 0;
+    for (uint32_t i=0; i < rpn_tokens_count; i++) {
+        var_tokens_count += rpn_tokens[i].type == LT_VAR;
+    }
+    if (var_tokens_count == 0) {
+        return true;
+    }
+    *output_var_names = allocator_alloc(allocator, (size_t)var_tokens_count*MEVAL_VAR_NAME_MAX_LEN);
+    if (*output_var_names == NULL) {
+        return false;
+    }
+    for (uint32_t i=0; i < rpn_tokens_count; i++) {
+        if (rpn_tokens[i].type != LT_VAR) {
+            continue;
+        }
+        uint32_t var_id = 0;
+        for (; var_id < *output_var_count; var_id++) {
+            if (strncmp((*output_var_names)[var_id], rpn_tokens[i].value.var_name, MEVAL_VAR_NAME_MAX_LEN) == 0) {
+                break;
+            }
+        }
+        if (var_id == *output_var_count) {
+            // Token names hold up to 'LEXEAME_CHAR_COUNT' chars, longer than a variable name.
+            const size_t name_char_count = strnlen(rpn_tokens[i].value.var_name, MEVAL_VAR_NAME_MAX_LEN-1);
+            memcpy((*output_var_names)[var_id], rpn_tokens[i].value.var_name, name_char_count);
+            (*output_var_names)[var_id][name_char_count] = '\0';
+            (*output_var_count)++;
+        }
+        rpn_tokens[i].value.var_id = var_id;
+    }
+    return true;
+}
+
+static bool find_var_slot(const char* var_name, const MEvalVarArr variables, uint32_t* output_slot) {
+    STATS_ADD(SC_VAR_LOOKUPS, 1);
+    for (uint32_t slot = 0; slot < variables.elements_count; slot++) {
+        if (strncmp(var_name, variables.arr_ptr[slot].name, MEVAL_VAR_NAME_MAX_LEN) == 0) {
+            *output_slot = slot;
+            return true;
+        }
+    }
+    DBPRINT("db: Could not find variable with name '%s', but used in expression\n", var_name);
+    return false;
+}
+
+static bool resolve_var_slots(char (*var_names)[MEVAL_VAR_NAME_MAX_LEN], uint32_t var_count, const MEvalVarArr variables, uint32_t* output_slots) {
+    /* Maps each name in 'var_names' to its index in 'variables'. Returns false if any name is not defined */
+    for (uint32_t var_id=0; var_id < var_count; var_id++) {
+        if (!find_var_slot(var_names[var_id], variables, &output_slots[var_id])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t get_scratch_count(const MEvalCompiledExpr* compiled_expr) {
+    /* Scratch layout: [var_count variable values][max_stack_depth number stack] */
+    return (size_t)compiled_expr->var_count + compiled_expr->max_stack_depth;
+}
+
+static double* acquire_scratch(const MEvalCompiledExpr* compiled_expr, const MEvalAllocator* allocator, double local_scratch[EVAL_LOCAL_SCRATCH_COUNT]) {
+    /* Returns 'local_scratch' when it is large enough, else memory from 'allocator' (NULL on failure) that must be passed to 'release_scratch' */
+    size_t scratch_count = get_scratch_count(compiled_expr);
+    if (scratch_count <= EVAL_LOCAL_SCRATCH_COUNT) {
+        return local_scratch;
+    }
+    return allocator_alloc(allocator, scratch_count*sizeof(double));
+}
+
+static void release_scratch(double* scratch, const MEvalAllocator* allocator, double local_scratch[EVAL_LOCAL_SCRATCH_COUNT]) {
+    if (scratch != local_scratch) {
+        allocator_free(allocator, scratch);
+    }
+}
+
+static inline double run_eval_bytecode(const MEvalCompiledExpr* compiled_expr, const double* var_values, double* number_stack) {
+    /* 'eval_bytecode( ... )', counted as one evaluation */
+    STATS_ADD(SC_EVAL_CALLS, 1);
+    STATS_PHASE_START(eval_start_ns);
+    double output = eval_bytecode(compiled_expr, var_values, number_stack);
+    STATS_PHASE_END(MEVAL_PHASE_EVAL, eval_start_ns);
+    return output;
+}
+
+static inline double run_jit_fn(const MEvalCompiledExpr* compiled_expr, const double* values) {
+    STATS_ADD(SC_EVAL_CALLS, 1);
+    STATS_PHASE_START(eval_start_ns);
+    double output = compiled_expr->jit_fn(values);
+    STATS_PHASE_END(MEVAL_PHASE_EVAL, eval_start_ns);
+    return output;
+}
+
+static double meval_internal_eval_by_name(const MEvalCompiledExpr* compiled_expr, const MEvalVarArr variables, double* scratch, MEvalError* output_error) {
+    /* Looks up every variable of the expression by name in 'variables', then evaluates it */
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return 0;
+    }
+    double* var_values = scratch;
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+        uint32_t slot = 0;
+        if (!find_var_slot(compiled_expr->var_names[var_id], variables, &slot)) {
+            set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_USE_OF_UNDEFINED_VAR));
+            return 0;
+        }
+        var_values[var_id] = variables.arr_ptr[slot].value;
+    }
+    return run_eval_bytecode(compiled_expr, var_values, scratch + compiled_expr->var_count);
+}
+
+static double meval_internal_eval_by_env(const MEvalCompiledExpr* compiled_expr, const MEvalVarEnv* env, double* scratch, MEvalError* output_error) {
+    /* Same as 'meval_internal_eval_by_name( ... )', looking the variables up in the hashed index of 'env' */
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return 0;
+    }
+    double* var_values = scratch;
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+        const char* var_name = compiled_expr->var_names[var_id];
+        uint32_t handle = find_env_var(env, var_name, strlen(var_name));
+        if (handle == MEVAL_VAR_ENV_NO_HANDLE) {
+            set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_USE_OF_UNDEFINED_VAR));
+            return 0;
+        }
+        var_values[var_id] = env->values[handle];
+    }
+    return run_eval_bytecode(compiled_expr, var_values, scratch + compiled_expr->var_count);
+}
+
+static double meval_internal_eval_bound(const MEvalCompiledExpr* compiled_expr, const double* values, double* scratch, MEvalError* output_error) {
+    /* Gathers the bound variable values into the scratch, then evaluates. Uses the JIT code instead, if there is any */
+    if (compiled_expr->jit_fn != NULL) {
+        return run_jit_fn(compiled_expr, values);
+    }
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return 0;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return 0;
+    }
+    double* var_values = scratch;
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+        var_values[var_id] = values[compiled_expr->var_slots[var_id]];
+    }
+    return run_eval_bytecode(compiled_expr, var_values, scratch + compiled_expr->var_count);
+}
+
+static void free_compiled_expr_members(MEvalCompiledExpr* compiled_expr) {
+    free_jit_code(compiled_expr);
+    allocator_free(&compiled_expr->allocator, compiled_expr->numbers);
+    allocator_free(&compiled_expr->allocator, compiled_expr->var_names);
+    allocator_free(&compiled_expr->allocator, compiled_expr->var_slots);
+    const MEvalAllocator allocator = compiled_expr->allocator;
+    memset(compiled_expr, 0, sizeof(MEvalCompiledExpr));
+    compiled_expr->allocator = allocator;
+}
+
+static void meval_internal_compile_cexpr(const char* input_string, bool support_variables, const MEvalVarArr expected_variables, const MEvalVarEnv* expected_env, MEvalCompiledExpr* output_compiled_expr, MEvalError* output_error) {
+    /*
+     * Compiles 'input_string' down to bytecode, allocating from 'output_compiled_expr->allocator',
+     *   and recognising the names of 'output_compiled_expr->registry' (may be NULL).
+     *   The members of 'output_compiled_expr' must be freed, even on error.
+     */
+    const MEvalAllocator* allocator = &output_compiled_expr->allocator;
+    LexToken* rpn_tokens = NULL;
+    uint32_t rpn_tokens_count = 0;
+    meval_internal_compile_expr(input_string, support_variables, expected_variables, expected_env, output_compiled_expr->registry, allocator, &rpn_tokens, &rpn_tokens_count, &output_compiled_expr->max_stack_depth, output_error);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        allocator_free(allocator, rpn_tokens);
+        return;
+    }
+    STATS_PHASE_START(codegen_start_ns);
+    if (!gen_var_table(rpn_tokens, rpn_tokens_count, allocator, &output_compiled_expr->var_names, &output_compiled_expr->var_count)
+            || !gen_bytecode(rpn_tokens, rpn_tokens_count, output_compiled_expr)) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+    }
+    STATS_PHASE_END(MEVAL_PHASE_CODEGEN, codegen_start_ns);
+    allocator_free(allocator, rpn_tokens);
+}
+
+static double meval_internal_run(const char* input_string, bool support_variables, const MEvalVarArr variables, const MEvalVarEnv* env, const MEvalAllocator* allocator, MEvalError* output_error) {
+    /* Compiles and evaluates in one go, taking the variables from 'env' instead of 'variables' if it is not NULL */
+
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalVarArr empty_variable_array = {0};
+
+    const MEvalVarArr final_variables = support_variables ? variables : empty_variable_array;
+
+    MEvalCompiledExpr compiled_expr = {0};
+    compiled_expr.allocator = allocator != NULL ? *allocator : default_allocator;
+    meval_internal_compile_cexpr(input_string, support_variables, final_variables, env, &compiled_expr, output_error);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        free_compiled_expr_members(&compiled_expr);
+        return 0;
+    }
+
+    double local_scratch[EVAL_LOCAL_SCRATCH_COUNT];
+    double* scratch = acquire_scratch(&compiled_expr, &compiled_expr.allocator, local_scratch);
+    double output = 0;
+    if (scratch == NULL) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+    } else {
+        output = env != NULL ? meval_internal_eval_by_env(&compiled_expr, env, scratch, output_error)
+            : meval_internal_eval_by_name(&compiled_expr, final_variables, scratch, output_error);
+        release_scratch(scratch, &compiled_expr.allocator, local_scratch);
+    }
+    free_compiled_expr_members(&compiled_expr);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        return 0;
+    }
+    
+    return output;
+}
+
+double meval(const char* input_string, MEvalError* error) {
+    MEvalVarArr empty_variables = {0};
+    return meval_internal_run(input_string, false, empty_variables, NULL, NULL, error);
+}
+
+double meval_alloc(const char* input_string, const MEvalAllocator* allocator, MEvalError* error) {
+    MEvalVarArr empty_variables = {0};
+    return meval_internal_run(input_string, false, empty_variables, NULL, allocator, error);
+}
+
+double meval_var(const char* input_string, const MEvalVarArr variables, MEvalError* error) {
+    return meval_internal_run(input_string, true, variables, NULL, NULL, error);
+}
+
+double meval_var_alloc(const char* input_string, const MEvalVarArr variables, const MEvalAllocator* allocator, MEvalError* error) {
+    return meval_internal_run(input_string, true, variables, NULL, allocator, error);
+}
+
+MEvalCompiledExpr* meval_var_compile(const char* input_string, MEvalError* output_error) {
+    return meval_var_compile_alloc(input_string, NULL, output_error);
+}
+
+MEvalCompiledExpr* meval_var_compile_alloc(const char* input_string, const MEvalAllocator* allocator, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalVarArr empty_variable_array = {0};
+
+    const MEvalAllocator* final_allocator = allocator != NULL ? allocator : &default_allocator;
+    MEvalCompiledExpr* compiled_expr = allocator_alloc(final_allocator, sizeof(MEvalCompiledExpr));
+    if (compiled_expr == NULL) {
+        output_error->type = MEVAL_PACKAGING_ERROR;
+        output_error->char_index = 0;
+        snprintf(output_error->message, MEVAL_ERROR_STRING_LEN, "Heap allocation failed");
+        return NULL;
+    }
+    memset(compiled_expr, 0, sizeof(MEvalCompiledExpr));
+    compiled_expr->allocator = *final_allocator;
+    meval_internal_compile_cexpr(input_string, true, empty_variable_array, NULL, compiled_expr, output_error);
+    return compiled_expr;
+}
+
+double meval_var_env(const char* input_string, const MEvalVarEnv* env, MEvalError* error) {
+    MEvalVarArr empty_variables = {0};
+    return meval_internal_run(input_string, true, empty_variables, env, NULL, error);
+}
+
+MEvalCompiledExpr* meval_var_compile_env(const char* input_string, const MEvalVarEnv* env, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalVarArr empty_variable_array = {0};
+
+    MEvalCompiledExpr* compiled_expr = allocator_alloc(&default_allocator, sizeof(MEvalCompiledExpr));
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(compiled_expr, 0, sizeof(MEvalCompiledExpr));
+    compiled_expr->allocator = default_allocator;
+    meval_internal_compile_cexpr(input_string, true, empty_variable_array, env, compiled_expr, output_error);
+    return compiled_expr;
+}
+
+static bool is_registry_name_taken(const MEvalRegistry* registry, const char* name) {
+    /* The registry's trie holds every built in and registered name */
+    uint16_t node = 0;
+    for (uint32_t char_index = 0; name[char_index] != '\0' && (node != 0 || char_index == 0); char_index++) {
+        node = identifier_trie_child(registry->trie, node, name[char_index]);
+    }
+    return node != 0 && registry->trie[node].is_full_name;
+}
+
+static bool check_registry_name(const MEvalRegistry* registry, const char* name, MEvalError* output_error) {
+    /* Names are made of letters only (see iconfig.h), so they lex as a single identifier */
+    if (registry == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registry is empty");
+        return false;
+    }
+    const size_t name_char_count = name != NULL ? strlen(name) : 0;
+    bool is_valid = name_char_count > 0 && name_char_count < MEVAL_VAR_NAME_MAX_LEN;
+    for (size_t i=0; i < name_char_count && is_valid; i++) {
+        is_valid = isalpha((unsigned char)name[i]);
+    }
+    if (!is_valid) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Invalid registry name");
+        return false;
+    }
+    if (is_registry_name_taken(registry, name)) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registry name is already in use");
+        return false;
+    }
+    if (registry->fns_count + registry->constants_count >= REGISTRY_MAX_NAMES_COUNT) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registry is full");
+        return false;
+    }
+    return true;
+}
+
+static bool reserve_registry_trie(MEvalRegistry* registry, const char* name, MEvalError* output_error) {
+    /* Makes room for the nodes 'name' may add, so inserting it cannot fail */
+    const uint32_t needed_count = registry->trie_nodes_count + strlen(name);
+    if (needed_count > (uint32_t)UINT16_MAX + 1) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registry is full");
+        return false;
+    }
+    if (needed_count <= registry->trie_capacity) {
+        return true;
+    }
+    uint32_t new_capacity = MAX(registry->trie_capacity*2, needed_count);
+    IdentifierTrieNode* trie = MEVAL_REALLOCARRAY(registry->trie, new_capacity, sizeof(IdentifierTrieNode));
+    if (trie == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return false;
+    }
+    registry->trie = trie;
+    registry->trie_capacity = new_capacity;
+    return true;
+}
+
+static void insert_registry_name(MEvalRegistry* registry, const char* name, enum LEX_TYPE type, uint16_t fn_index) {
+    /*
+     * Updates the nodes along 'name' as 'gen_identifier_match' would with the
+     *   name after every other, without going over the other names. Names are
+     *   unique, so the last node is never already a full name.
+     */
+    IdentifierTrieNode* trie = registry->trie;
+    uint16_t node = 0;
+    for (uint32_t char_index = 0; name[char_index] != '\0'; char_index++) {
+        const bool is_full_name = name[char_index+1] == '\0';
+        uint16_t child = identifier_trie_child(trie, node, name[char_index]);
+        if (child == 0) {
+            child = registry->trie_nodes_count++;
+            trie[child] = (IdentifierTrieNode){.c=name[char_index], .first_child=0, .next_sibling=trie[node].first_child};
+            trie[node].first_child = child;
+        }
+        if (is_full_name || !trie[child].is_full_name) {
+            trie[child].type = type;
+            trie[child].fn_index = fn_index;
+            trie[child].found_count = is_full_name ? 1 : trie[child].found_count + 1;
+            trie[child].is_full_name = is_full_name;
+        }
+        node = child;
+    }
+}
+
+static bool add_registry_fn(MEvalRegistry* registry, const RegisteredFn* fn, MEvalError* output_error) {
+    if (!check_registry_name(registry, fn->name, output_error) || !reserve_registry_trie(registry, fn->name, output_error)) {
+        return false;
+    }
+    RegisteredFn* fns = MEVAL_REALLOCARRAY(registry->fns, registry->fns_count+1, sizeof(RegisteredFn));
+    if (fns == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return false;
+    }
+    registry->fns = fns;
+    registry->fns[registry->fns_count] = *fn;
+    insert_registry_name(registry, fn->name, LT_USER_FUNCTION, registry->fns_count);
+    registry->fns_count++;
+    return true;
+}
+
+MEvalRegistry* meval_registry_create(MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalRegistry* registry = MEVAL_MALLOC(sizeof(MEvalRegistry));
+    if (registry == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(registry, 0, sizeof(MEvalRegistry));
+    registry->trie = gen_identifier_trie(&registry->trie_nodes_count);
+    registry->trie_capacity = registry->trie_nodes_count;
+    if (registry->trie == NULL) {
+        MEVAL_FREE(registry);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    return registry;
+}
+
+bool meval_registry_add_unary(MEvalRegistry* registry, const char* name, MEvalUnaryCallback callback, void* userdata, bool pure, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    RegisteredFn fn = {.op=OP_USER_UNARY_FN, .args_count=1, .fnptr.unary=callback, .userdata=userdata, .pure=pure};
+    snprintf(fn.name, MEVAL_VAR_NAME_MAX_LEN, "%s", name != NULL ? name : "");
+    return add_registry_fn(registry, &fn, output_error);
+}
+
+bool meval_registry_add_binary(MEvalRegistry* registry, const char* name, MEvalBinaryCallback callback, void* userdata, bool pure, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    RegisteredFn fn = {.op=OP_USER_BINARY_FN, .args_count=2, .fnptr.binary=callback, .userdata=userdata, .pure=pure};
+    snprintf(fn.name, MEVAL_VAR_NAME_MAX_LEN, "%s", name != NULL ? name : "");
+    return add_registry_fn(registry, &fn, output_error);
+}
+
+bool meval_registry_add_nary(MEvalRegistry* registry, const char* name, uint32_t args_count, MEvalNaryCallback callback, void* userdata, bool pure, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (args_count == 0 || args_count > CALL_MAX_ARGS_COUNT) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Arguments count must be 1 to 64");
+        return false;
+    }
+    RegisteredFn fn = {.op=OP_USER_NARY_FN, .args_count=args_count, .fnptr.nary=callback, .userdata=userdata, .pure=pure};
+    snprintf(fn.name, MEVAL_VAR_NAME_MAX_LEN, "%s", name != NULL ? name : "");
+    return add_registry_fn(registry, &fn, output_error);
+}
+
+bool meval_registry_add_constant(MEvalRegistry* registry, const char* name, double value, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (!check_registry_name(registry, name, output_error) || !reserve_registry_trie(registry, name, output_error)) {
+        return false;
+    }
+    RegisteredConstant* registered_constants = MEVAL_REALLOCARRAY(registry->constants, registry->constants_count+1, sizeof(RegisteredConstant));
+    if (registered_constants == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return false;
+    }
+    registry->constants = registered_constants;
+    RegisteredConstant* constant = &registry->constants[registry->constants_count++];
+    snprintf(constant->name, MEVAL_VAR_NAME_MAX_LEN, "%s", name);
+    constant->value = value;
+    insert_registry_name(registry, name, LT_NUMBER, registry->constants_count-1);
+    return true;
+}
+
+MEvalCompiledExpr* meval_var_compile_registry(const char* input_string, const MEvalRegistry* registry, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalVarArr empty_variable_array = {0};
+
+    MEvalCompiledExpr* compiled_expr = allocator_alloc(&default_allocator, sizeof(MEvalCompiledExpr));
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(compiled_expr, 0, sizeof(MEvalCompiledExpr));
+    compiled_expr->allocator = default_allocator;
+    compiled_expr->registry = registry;
+    meval_internal_compile_cexpr(input_string, true, empty_variable_array, NULL, compiled_expr, output_error);
+    return compiled_expr;
+}
+
+void meval_registry_free(MEvalRegistry** registry) {
+    if ((*registry) != NULL) {
+        MEVAL_FREE((*registry)->fns);
+        MEVAL_FREE((*registry)->constants);
+        MEVAL_FREE((*registry)->trie);
+        MEVAL_FREE(*registry);
+        *registry = NULL;
+    }
+}
+
+double meval_var_eval_cexpr(const MEvalCompiledExpr* compiled_expr, const MEvalVarArr variables, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        output_error->type = MEVAL_PACKAGING_ERROR;
+        output_error->char_index = 0;
+        snprintf(output_error->message, MEVAL_ERROR_STRING_LEN, "Compiled expression is empty");
+        return 0;
+    }
+
+    double local_scratch[EVAL_LOCAL_SCRATCH_COUNT];
+    double* scratch = acquire_scratch(compiled_expr, &default_allocator, local_scratch);
+    if (scratch == NULL) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+        return 0;
+    }
+    double output = meval_internal_eval_by_name(compiled_expr, variables, scratch, output_error);
+    release_scratch(scratch, &default_allocator, local_scratch);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        return 0;
+    }
+    return output;
+}
+
+double meval_var_eval_cexpr_env(const MEvalCompiledExpr* compiled_expr, const MEvalVarEnv* env, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL || env == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, compiled_expr == NULL ? "Compiled expression is empty" : "Variable environment is empty");
+        return 0;
+    }
+
+    double local_scratch[EVAL_LOCAL_SCRATCH_COUNT];
+    double* scratch = acquire_scratch(compiled_expr, &default_allocator, local_scratch);
+    if (scratch == NULL) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+        return 0;
+    }
+    double output = meval_internal_eval_by_env(compiled_expr, env, scratch, output_error);
+    release_scratch(scratch, &default_allocator, local_scratch);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        return 0;
+    }
+    return output;
+}
+
+bool meval_var_bind_cexpr(MEvalCompiledExpr* compiled_expr, const MEvalVarArr variables, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return false;
+    }
+    free_jit_code(compiled_expr); // Compiled against the previous binding.
+    if (compiled_expr->var_slots == NULL) {
+        compiled_expr->var_slots = allocator_alloc(&compiled_expr->allocator, MAX(compiled_expr->var_count, 1)*sizeof(uint32_t));
+        if (compiled_expr->var_slots == NULL) {
+            set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+            return false;
+        }
+    }
+    if (!resolve_var_slots(compiled_expr->var_names, compiled_expr->var_count, variables, compiled_expr->var_slots)) {
+        allocator_free(&compiled_expr->allocator, compiled_expr->var_slots);
+        compiled_expr->var_slots = NULL;
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_USE_OF_UNDEFINED_VAR));
+        return false;
+    }
+    return true;
+}
+
+bool meval_var_bind_cexpr_env(MEvalCompiledExpr* compiled_expr, const MEvalVarEnv* env, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL || env == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, compiled_expr == NULL ? "Compiled expression is empty" : "Variable environment is empty");
+        return false;
+    }
+    free_jit_code(compiled_expr); // Compiled against the previous binding.
+    if (compiled_expr->var_slots == NULL) {
+        compiled_expr->var_slots = allocator_alloc(&compiled_expr->allocator, MAX(compiled_expr->var_count, 1)*sizeof(uint32_t));
+        if (compiled_expr->var_slots == NULL) {
+            set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+            return false;
+        }
+    }
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) { // A variable's slot is its handle.
+        const char* var_name = compiled_expr->var_names[var_id];
+        compiled_expr->var_slots[var_id] = find_env_var(env, var_name, strlen(var_name));
+        if (compiled_expr->var_slots[var_id] == MEVAL_VAR_ENV_NO_HANDLE) {
+            allocator_free(&compiled_expr->allocator, compiled_expr->var_slots);
+            compiled_expr->var_slots = NULL;
+            set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_USE_OF_UNDEFINED_VAR));
+            return false;
+        }
+    }
+    return true;
+}
+
+double meval_var_eval_bound_cexpr(const MEvalCompiledExpr* compiled_expr, const double* values, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return 0;
+    }
+
+    if (compiled_expr->jit_fn != NULL) {
+        return run_jit_fn(compiled_expr, values);
+    }
+
+    double local_scratch[EVAL_LOCAL_SCRATCH_COUNT];
+    double* scratch = acquire_scratch(compiled_expr, &default_allocator, local_scratch);
+    if (scratch == NULL) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+        return 0;
+    }
+    double output = meval_internal_eval_bound(compiled_expr, values, scratch, output_error);
+    release_scratch(scratch, &default_allocator, local_scratch);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        return 0;
+    }
+    return output;
+}
+
+double meval_var_eval_bound_cexpr_scratch(const MEvalCompiledExpr* compiled_expr, const double* values, double* scratch, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return 0;
+    }
+    double output = meval_internal_eval_bound(compiled_expr, values, scratch, output_error);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        return 0;
+    }
+    return output;
+}
+
+uint32_t meval_cexpr_scratch_count(const MEvalCompiledExpr* compiled_expr) {
+    return compiled_expr == NULL ? 0 : get_scratch_count(compiled_expr);
+}
+
+/*
+ * Gradients use reverse mode automatic differentiation. The forward pass runs
+ *   the bytecode, recording every instruction's value and the tape entries of
+ *   its operands. The reverse pass then walks the tape backwards, pushing each
+ *   entry's adjoint (d output / d entry) onto its operands with the derivatives
+ *   of 'unary_fns'/'binary_fns'/'nary_fns'. A variable's adjoints sum up to its gradient.
+ * Jumps are taken, so a branch not taken has no entries, and so no say in the gradient.
+ */
+typedef struct {
+    double value;
+    double adjoint;
+    uint32_t a; // Operand tape entry, var_id of OP_VAR, start of the operand entries in 'call_args' for n-ary functions.
+    uint32_t b; // Second operand tape entry of binary functions, arguments count of n-ary functions.
+    uint8_t op; // Instruction recorded, OP_NUMBER for the value a skipped '&'/'|' leaves.
+} TapeEntry;
+
+static double eval_bytecode_gradient(const MEvalCompiledExpr* compiled_expr, const double* values, TapeEntry* tape, uint32_t* entry_stack, uint32_t* call_args, double* gradient) {
+    /*
+     * 'tape' must hold 'ops_count' entries, 'entry_stack' 'max_stack_depth' indices and 'call_args'
+     *   'ops_count' indices (every entry is the argument of at most one function). 'gradient' is indexed by var_id.
+     */
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    uint32_t stack_count = 0;
+    uint32_t entries_count = 0;
+    uint32_t call_args_count = 0;
+    double args[CALL_MAX_ARGS_COUNT];
+    for (uint32_t ops_index = 0; ops_index < compiled_expr->ops_count; ops_index++) {
+        const uint8_t op = compiled_expr->ops[ops_index];
+        if (op == OP_SELECT) { // Only reached after 'b', as in 'eval_bytecode'.
+            continue;
+        } else if (is_jump_op(op)) {
+            const uint32_t* target = operands;
+            operands += JUMP_OPERANDS_COUNT;
+            const double top_value = tape[entry_stack[stack_count-1]].value;
+            const bool is_jump_taken = op == OP_JUMP || (op == OP_SKIP_IF_TRUE ? top_value != 0 : top_value == 0);
+            if (op == OP_JUMP_IF_FALSE) {
+                stack_count--;
+            } else if (is_jump_taken && op != OP_JUMP) { // '&'/'|' is decided by its first operand alone.
+                tape[entries_count] = (TapeEntry){.value=op == OP_SKIP_IF_TRUE, .adjoint=0, .a=0, .b=0, .op=OP_NUMBER};
+                entry_stack[stack_count-1] = entries_count++;
+            }
+            if (is_jump_taken) {
+                ops_index = target[0] - 1;
+                numbers = compiled_expr->numbers + target[1];
+                operands = compiled_expr->operands + target[2];
+            }
+            continue;
+        }
+        TapeEntry* entry = &tape[entries_count];
+        entry->op = op;
+        entry->adjoint = 0;
+        if (op == OP_NUMBER) {
+            entry->value = *numbers++;
+        } else if (op == OP_VAR) {
+            entry->a = *operands++;
+            entry->value = values[compiled_expr->var_slots[entry->a]];
+        } else if (op < OP_BINARY_FN) {
+            entry->a = entry_stack[--stack_count];
+            entry->value = eval_fn_op(op, tape[entry->a].value, 0);
+        } else if (op >= OP_NARY_FN) {
+            entry->b = *operands++;
+            entry->a = call_args_count;
+            stack_count -= entry->b;
+            for (uint32_t i=0; i < entry->b; i++) {
+                call_args[call_args_count++] = entry_stack[stack_count + i];
+                args[i] = tape[entry_stack[stack_count + i]].value;
+            }
+            entry->value = nary_fns[op - OP_NARY_FN].fnptr(args, entry->b);
+        } else {
+            entry->b = entry_stack[--stack_count];
+            entry->a = entry_stack[--stack_count];
+            entry->value = eval_fn_op(op, tape[entry->a].value, tape[entry->b].value);
+        }
+        entry_stack[stack_count++] = entries_count++;
+    }
+
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+        gradient[var_id] = 0;
+    }
+    const uint32_t output_index = entry_stack[0];
+    tape[output_index].adjoint = 1;
+    for (uint32_t entry_index = entries_count; entry_index-- > 0;) {
+        const TapeEntry* entry = &tape[entry_index];
+        const uint8_t op = entry->op;
+        if (op == OP_NUMBER) {
+            continue;
+        } else if (op == OP_VAR) {
+            gradient[entry->a] += entry->adjoint;
+        } else if (op < OP_BINARY_FN) {
+            const double da = unary_fns[op - OP_UNARY_FN].dfnptr(tape[entry->a].value, entry->value);
+            tape[entry->a].adjoint += entry->adjoint * da;
+        } else if (op >= OP_NARY_FN) {
+            double d_args[CALL_MAX_ARGS_COUNT];
+            for (uint32_t i=0; i < entry->b; i++) {
+                args[i] = tape[call_args[entry->a + i]].value;
+            }
+            nary_fns[op - OP_NARY_FN].dfnptr(args, entry->b, entry->value, d_args);
+            for (uint32_t i=0; i < entry->b; i++) {
+                tape[call_args[entry->a + i]].adjoint += entry->adjoint * d_args[i];
+            }
+        } else {
+            double da = 0;
+            double db = 0;
+            binary_fns[op - OP_BINARY_FN].dfnptr(tape[entry->a].value, tape[entry->b].value, entry->value, &da, &db);
+            tape[entry->a].adjoint += entry->adjoint * da;
+            tape[entry->b].adjoint += entry->adjoint * db;
+        }
+    }
+    return tape[output_index].value;
+}
+
+double meval_var_grad_bound_cexpr(const MEvalCompiledExpr* compiled_expr, const double* values, double* gradient, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return 0;
+    }
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return 0;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return 0;
+    }
+    if (compiled_expr->registry != NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registered functions are not supported here");
+        return 0;
+    }
+
+    TapeEntry local_tape[EVAL_LOCAL_SCRATCH_COUNT];
+    uint32_t local_entry_stack[EVAL_LOCAL_SCRATCH_COUNT];
+    uint32_t local_call_args[EVAL_LOCAL_SCRATCH_COUNT];
+    TapeEntry* tape = local_tape;
+    uint32_t* entry_stack = local_entry_stack;
+    uint32_t* call_args = local_call_args;
+    if (compiled_expr->ops_count > EVAL_LOCAL_SCRATCH_COUNT) {
+        // The stack is never deeper than the number of instructions.
+        tape = MEVAL_MALLOC(compiled_expr->ops_count*(sizeof(TapeEntry) + 2*sizeof(uint32_t)));
+        if (tape == NULL) {
+            set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+            return 0;
+        }
+        entry_stack = (uint32_t*)(tape + compiled_expr->ops_count);
+        call_args = entry_stack + compiled_expr->ops_count;
+    }
+    double output = eval_bytecode_gradient(compiled_expr, values, tape, entry_stack, call_args, gradient);
+    if (tape != local_tape) {
+        MEVAL_FREE(tape);
+    }
+    return output;
+}
+
+static Interval interval_of_value(double lo, double hi) {
+    /* NaN bounds are taken as unknown */
+    if (isnan(lo) || isnan(hi)) {
+        return interval_whole(true);
+    }
+    return (Interval){.lo=lo, .hi=hi, .maybe_nan=false};
+}
+
+static Interval eval_bytecode_interval(const MEvalCompiledExpr* compiled_expr, const MEvalInterval* ranges, Interval* interval_stack) {
+    /* Same as 'eval_bytecode', over intervals. 'interval_stack' must hold 'max_stack_depth' intervals */
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    Interval* stack_top = interval_stack - 1;
+    for (uint32_t ops_index = 0; ops_index < compiled_expr->ops_count; ops_index++) {
+        const uint8_t op = compiled_expr->ops[ops_index];
+        if (op == OP_NUMBER) {
+            const double number = *numbers++;
+            *++stack_top = interval_of_value(number, number);
+        } else if (op == OP_VAR) {
+            const MEvalInterval range = ranges[compiled_expr->var_slots[*operands++]];
+            *++stack_top = interval_of_value(range.lo, range.hi);
+        } else if (op < OP_BINARY_FN) {
+            *stack_top = unary_fns[op - OP_UNARY_FN].ifnptr(*stack_top);
+        } else if (op < OP_NARY_FN) {
+            stack_top--;
+            stack_top[0] = binary_fns[op - OP_BINARY_FN].ifnptr(stack_top[0], stack_top[1]);
+        } else if (op < OP_END) {
+            const uint32_t args_count = *operands++;
+            stack_top -= args_count - 1;
+            stack_top[0] = nary_fns[op - OP_NARY_FN].ifnptr(stack_top, args_count);
+        } else if (op == OP_SELECT) { // Both branches were evaluated.
+            stack_top -= 2;
+            stack_top[0] = nary_fns[NFN_IF].ifnptr(stack_top, 3);
+        } else if (op >= OP_JUMP_IF_FALSE) {
+            operands += JUMP_OPERANDS_COUNT; // Not taken, as the condition may be uncertain.
+        } else { // Nothing is known about registered functions.
+            stack_top -= compiled_expr->registry->fns[*operands++].args_count - 1;
+            stack_top[0] = interval_whole(true);
+        }
+    }
+    return interval_stack[0];
+}
+
+MEvalInterval meval_var_eval_bound_cexpr_interval(const MEvalCompiledExpr* compiled_expr, const MEvalInterval* ranges, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    MEvalInterval output = {.lo=0, .hi=0};
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return output;
+    }
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return output;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return output;
+    }
+
+    Interval local_stack[EVAL_LOCAL_SCRATCH_COUNT];
+    Interval* interval_stack = local_stack;
+    if (compiled_expr->max_stack_depth > EVAL_LOCAL_SCRATCH_COUNT) {
+        interval_stack = MEVAL_MALLOC(compiled_expr->max_stack_depth*sizeof(Interval));
+        if (interval_stack == NULL) {
+            set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+            return output;
+        }
+    }
+    const Interval result = eval_bytecode_interval(compiled_expr, ranges, interval_stack);
+    if (interval_stack != local_stack) {
+        MEVAL_FREE(interval_stack);
+    }
+    output.lo = result.lo;
+    output.hi = result.hi;
+    return output;
+}
+
+/*
+ * Incremental evaluation keeps the value of every instruction of a bound
+ *   expression. As compiled bytecode is a tree, each instruction's value is an
+ *   operand of exactly one later instruction, its parent. Setting a variable
+ *   updates its OP_VAR nodes and marks their parents dirty, evaluating then
+ *   recomputes dirty nodes in instruction order (operands before parents),
+ *   only marking a parent dirty when its operand's value actually changed.
+ *   Jumps are not nodes, both branches of 'if', '&' and '|' are kept up to
+ *   date, so that changing the condition never has to evaluate a whole branch.
+ */
+#define EVAL_CONTEXT_NO_PARENT UINT32_MAX
+
+typedef struct MEvalEvalContext {
+    double* values; // Value of every node (instruction).
+    uint64_t* dirty_words; // Bit per node, set when it has to be recomputed.
+    uint32_t dirty_words_count;
+    uint32_t first_dirty_word; // No dirty bits before this word.
+    uint32_t* operands_a; // Operand node of functions, start of the operand nodes in 'call_args' for n-ary functions.
+    uint32_t* operands_b; // Second operand node of binary functions, arguments count of n-ary functions.
+    uint32_t* parents; // Node using this node's value, EVAL_CONTEXT_NO_PARENT for the root.
+    uint32_t* call_args; // Operand nodes of every n-ary function, a node is the argument of at most one.
+    uint32_t* var_leaves_start; // The OP_VAR nodes of var_id are 'var_leaves[var_leaves_start[var_id] ... var_leaves_start[var_id+1]-1]'.
+    uint32_t* var_leaves;
+    uint32_t* var_slots; // Copy of the compiled expression's binding.
+    uint8_t* ops;
+    uint32_t nodes_count;
+    uint32_t var_count;
+} MEvalEvalContext;
+
+static inline uint32_t count_trailing_zeros(uint64_t word) {
+    /* 'word' must not be 0 */
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    uint32_t count = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+static void mark_eval_context_dirty(MEvalEvalContext* context, uint32_t node_index) {
+    const uint32_t word_index = node_index/64;
+    context->dirty_words[word_index] |= (uint64_t)1 << (node_index%64);
+    context->first_dirty_word = MIN(context->first_dirty_word, word_index);
+}
+
+static void set_eval_context_node(MEvalEvalContext* context, uint32_t node_index, double value) {
+    /* Stores 'value', marking the parent dirty if it changed. Compared bitwise, so that NaN counts as unchanged */
+    if (memcmp(&context->values[node_index], &value, sizeof(double)) != 0) {
+        context->values[node_index] = value;
+        if (context->parents[node_index] != EVAL_CONTEXT_NO_PARENT) {
+            mark_eval_context_dirty(context, context->parents[node_index]);
+        }
+    }
+}
+
+static double eval_context_node(const MEvalEvalContext* context, uint32_t node_index) {
+    /* Computes function node 'node_index' from the values of its operands */
+    const uint8_t op = context->ops[node_index];
+    if (op >= OP_NARY_FN) {
+        double args[CALL_MAX_ARGS_COUNT];
+        const uint32_t args_count = context->operands_b[node_index];
+        for (uint32_t i=0; i < args_count; i++) {
+            args[i] = context->values[context->call_args[context->operands_a[node_index] + i]];
+        }
+        return get_nary_fn(op)->fnptr(args, args_count);
+    }
+    return eval_fn_op(op, context->values[context->operands_a[node_index]], context->values[context->operands_b[node_index]]);
+}
+
+static void eval_context_dirty_nodes(MEvalEvalContext* context) {
+    /* Parents always come after their operands, so a dirty bit set while going through the words is still ahead */
+    for (uint32_t word_index = context->first_dirty_word; word_index < context->dirty_words_count; word_index++) {
+        while (context->dirty_words[word_index] != 0) {
+            const uint64_t word = context->dirty_words[word_index];
+            const uint32_t node_index = word_index*64 + count_trailing_zeros(word);
+            context->dirty_words[word_index] = word & (word - 1);
+            set_eval_context_node(context, node_index, eval_context_node(context, node_index));
+        }
+    }
+    context->first_dirty_word = context->dirty_words_count;
+}
+
+MEvalEvalContext* meval_eval_context_create(const MEvalCompiledExpr* compiled_expr, const double* values, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL || compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return NULL;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return NULL;
+    }
+    if (compiled_expr->registry != NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registered functions are not supported here");
+        return NULL;
+    }
+
+    const uint32_t nodes_count = compiled_expr->ops_count;
+    const uint32_t var_count = compiled_expr->var_count;
+    const uint32_t dirty_words_count = (nodes_count + 63)/64;
+    const uint32_t stack_count = MAX(compiled_expr->max_stack_depth, 1);
+    /* One allocation, widest members first: values, dirty_words, then the uint32_t arrays (the node stack is only used here) and ops */
+    const size_t uint32s_count = 4*(size_t)nodes_count + (var_count+1) + compiled_expr->operands_count + var_count + stack_count;
+    MEvalEvalContext* context = MEVAL_MALLOC(sizeof(MEvalEvalContext));
+    unsigned char* memory = MEVAL_MALLOC(nodes_count*sizeof(double) + dirty_words_count*sizeof(uint64_t) + uint32s_count*sizeof(uint32_t) + nodes_count);
+    if (context == NULL || memory == NULL) {
+        MEVAL_FREE(context);
+        MEVAL_FREE(memory);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    context->values = (double*)memory;
+    context->dirty_words = (uint64_t*)(context->values + nodes_count);
+    context->operands_a = (uint32_t*)(context->dirty_words + dirty_words_count);
+    context->operands_b = context->operands_a + nodes_count;
+    context->parents = context->operands_b + nodes_count;
+    context->call_args = context->parents + nodes_count;
+    context->var_leaves_start = context->call_args + nodes_count;
+    context->var_leaves = context->var_leaves_start + var_count+1;
+    context->var_slots = context->var_leaves + compiled_expr->operands_count;
+    uint32_t* node_stack = context->var_slots + var_count;
+    context->ops = (uint8_t*)(node_stack + stack_count);
+    context->nodes_count = nodes_count;
+    context->var_count = var_count;
+    context->dirty_words_count = dirty_words_count;
+    context->first_dirty_word = dirty_words_count;
+    memset(context->dirty_words, 0, dirty_words_count*sizeof(uint64_t));
+    memcpy(context->ops, compiled_expr->ops, nodes_count);
+    memcpy(context->var_slots, compiled_expr->var_slots, var_count*sizeof(uint32_t));
+
+    /* Links every node to its operands and parent while evaluating it in full once */
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    uint32_t stack_count_used = 0;
+    uint32_t call_args_count = 0;
+    memset(context->var_leaves_start, 0, (var_count+1)*sizeof(uint32_t));
+    for (uint32_t node_index = 0; node_index < nodes_count; node_index++) {
+        const uint8_t op = context->ops[node_index];
+        context->parents[node_index] = EVAL_CONTEXT_NO_PARENT;
+        context->operands_a[node_index] = 0;
+        context->operands_b[node_index] = 0;
+        if (op == OP_NUMBER) {
+            context->values[node_index] = *numbers++;
+        } else if (op == OP_VAR) {
+            const uint32_t var_id = *operands++;
+            context->operands_a[node_index] = var_id;
+            context->var_leaves_start[var_id+1]++;
+            context->values[node_index] = values[context->var_slots[var_id]];
+        } else if (is_jump_op(op)) { // Not a node of the tree, both branches are kept up to date.
+            context->values[node_index] = 0;
+            operands += JUMP_OPERANDS_COUNT;
+            continue;
+        } else if (op >= OP_NARY_FN) {
+            const uint32_t args_count = op == OP_SELECT ? 3 : *operands++;
+            stack_count_used -= args_count;
+            context->operands_a[node_index] = call_args_count;
+            context->operands_b[node_index] = args_count;
+            for (uint32_t i=0; i < args_count; i++) {
+                context->call_args[call_args_count++] = node_stack[stack_count_used + i];
+                context->parents[node_stack[stack_count_used + i]] = node_index;
+            }
+            context->values[node_index] = eval_context_node(context, node_index);
+        } else {
+            if (op >= OP_BINARY_FN) {
+                context->operands_b[node_index] = node_stack[--stack_count_used];
+                context->parents[context->operands_b[node_index]] = node_index;
+            }
+            context->operands_a[node_index] = node_stack[--stack_count_used];
+            context->parents[context->operands_a[node_index]] = node_index;
+            context->values[node_index] = eval_fn_op(op, context->values[context->operands_a[node_index]], context->values[context->operands_b[node_index]]);
+        }
+        node_stack[stack_count_used++] = node_index;
+    }
+    /* Turns the counts into start offsets, fills in the OP_VAR nodes of each var_id by advancing its start, then shifts the starts back */
+    for (uint32_t var_id=0; var_id < var_count; var_id++) {
+        context->var_leaves_start[var_id+1] += context->var_leaves_start[var_id];
+    }
+    for (uint32_t node_index = 0; node_index < nodes_count; node_index++) {
+        if (context->ops[node_index] == OP_VAR) {
+            context->var_leaves[context->var_leaves_start[context->operands_a[node_index]]++] = node_index;
+        }
+    }
+    for (uint32_t var_id = var_count; var_id > 0; var_id--) {
+        context->var_leaves_start[var_id] = context->var_leaves_start[var_id-1];
+    }
+    context->var_leaves_start[0] = 0;
+    return context;
+}
+
+void meval_eval_context_set(MEvalEvalContext* context, uint32_t slot, double value) {
+    for (uint32_t var_id=0; var_id < context->var_count; var_id++) {
+        if (context->var_slots[var_id] == slot) {
+            for (uint32_t i = context->var_leaves_start[var_id]; i < context->var_leaves_start[var_id+1]; i++) {
+                set_eval_context_node(context, context->var_leaves[i], value);
+            }
+            return;
+        }
+    }
+}
+
+double meval_eval_context_eval(MEvalEvalContext* context) {
+    eval_context_dirty_nodes(context);
+    return context->values[context->nodes_count-1];
+}
+
+void meval_eval_context_free(MEvalEvalContext** context) {
+    if ((*context) != NULL) {
+        MEVAL_FREE((*context)->values);
+        MEVAL_FREE(*context);
+        *context = NULL;
+    }
+}
+
+bool meval_var_eval_bound_cexpr_batch(const MEvalCompiledExpr* compiled_expr, const double* const* columns, size_t rows_count, double* output, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return false;
+    }
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return false;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return false;
+    }
+    double* block_stack = MEVAL_MALLOC((size_t)compiled_expr->max_stack_depth*EVAL_BATCH_BLOCK_LEN*sizeof(double));
+    if (block_stack == NULL) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+        return false;
+    }
+    STATS_ADD(SC_BATCH_ROWS, rows_count);
+    STATS_PHASE_START(eval_start_ns);
+    for (size_t row_start = 0; row_start < rows_count; row_start += EVAL_BATCH_BLOCK_LEN) {
+        eval_bytecode_block(compiled_expr, columns, row_start, MIN(rows_count - row_start, EVAL_BATCH_BLOCK_LEN), block_stack, output);
+    }
+    STATS_PHASE_END(MEVAL_PHASE_EVAL, eval_start_ns);
+    MEVAL_FREE(block_stack);
+    return true;
+}
+
+/*
+ * Parallel batch evaluation. The rows are split into one contiguous range per
+ *   worker. Workers claim chunks of EVAL_PARALLEL_CHUNK_LEN rows from the
+ *   front of their own range, then steal chunks from the other ranges once
+ *   theirs is used up, so a slow (or failed) worker never holds up the rest.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_LEN) atomic_size_t next_row; // Hit mostly by its own worker, so kept on its own cache line (the array is aligned to one too).
+    size_t end_row;
+} ParallelRange;
+
+typedef struct {
+    const MEvalCompiledExpr* compiled_expr;
+    const double* const* columns;
+    double* output;
+    ParallelRange* ranges;
+    uint32_t workers_count;
+} ParallelBatch;
+
+typedef struct {
+    ParallelBatch* batch;
+    uint32_t worker_index;
+    pthread_t thread;
+} ParallelWorker;
+
+static bool claim_parallel_chunk(ParallelRange* range, size_t* output_row_start, size_t* output_rows_count) {
+    size_t row_start = atomic_fetch_add_explicit(&range->next_row, EVAL_PARALLEL_CHUNK_LEN, memory_order_relaxed);
+    if (row_start >= range->end_row) {
+        return false;
+    }
+    *output_row_start = row_start;
+    *output_rows_count = MIN(range->end_row - row_start, EVAL_PARALLEL_CHUNK_LEN);
+    return true;
+}
+
+static void run_parallel_worker(ParallelBatch* batch, uint32_t worker_index, double* block_stack) {
+    for (uint32_t i=0; i < batch->workers_count; i++) { // Own range first, then the others.
+        ParallelRange* range = &batch->ranges[(worker_index + i) % batch->workers_count];
+        size_t row_start = 0;
+        size_t rows_count = 0;
+        while (claim_parallel_chunk(range, &row_start, &rows_count)) {
+            for (size_t block_start = row_start; block_start < row_start + rows_count; block_start += EVAL_BATCH_BLOCK_LEN) {
+                eval_bytecode_block(batch->compiled_expr, batch->columns, block_start, MIN(row_start + rows_count - block_start, EVAL_BATCH_BLOCK_LEN), block_stack, batch->output);
+            }
+        }
+    }
+}
+
+static void* parallel_worker_main(void* arg) {
+    ParallelWorker* worker = arg;
+    double* block_stack = MEVAL_MALLOC((size_t)MAX(worker->batch->compiled_expr->max_stack_depth, 1)*EVAL_BATCH_BLOCK_LEN*sizeof(double));
+    if (block_stack == NULL) {
+        return NULL; // Its range gets stolen by the other workers.
+    }
+    run_parallel_worker(worker->batch, worker->worker_index, block_stack);
+    MEVAL_FREE(block_stack);
+    return NULL;
+}
+
+bool meval_var_eval_bound_cexpr_batch_parallel(const MEvalCompiledExpr* compiled_expr, const double* const* columns, size_t rows_count, double* output, uint32_t threads_count, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return false;
+    }
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return false;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return false;
+    }
+    if (threads_count == 0) {
+        long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_count = online_cpus > 0 ? (uint32_t)MIN(online_cpus, UINT32_MAX) : 1;
+    }
+    const size_t chunks_count = (rows_count + EVAL_PARALLEL_CHUNK_LEN-1) / EVAL_PARALLEL_CHUNK_LEN;
+    const uint32_t workers_count = (uint32_t)MAX(MIN((size_t)threads_count, chunks_count), 1);
+
+    // The calling thread is worker 0, its stack is allocated first so there is always at least one worker.
+    double* block_stack = MEVAL_MALLOC((size_t)MAX(compiled_expr->max_stack_depth, 1)*EVAL_BATCH_BLOCK_LEN*sizeof(double));
+    // 'MEVAL_MALLOC' only aligns for the basic types, so one line extra is allocated to align 'ranges' within.
+    void* ranges_allocation = MEVAL_MALLOC(workers_count*sizeof(ParallelRange) + CACHE_LINE_LEN-1);
+    ParallelRange* ranges = (ParallelRange*)(((uintptr_t)ranges_allocation + CACHE_LINE_LEN-1) & ~(uintptr_t)(CACHE_LINE_LEN-1));
+    ParallelWorker* workers = MEVAL_MALLOC(workers_count*sizeof(ParallelWorker));
+    if (block_stack == NULL || ranges_allocation == NULL || workers == NULL) {
+        MEVAL_FREE(block_stack);
+        MEVAL_FREE(ranges_allocation);
+        MEVAL_FREE(workers);
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+        return false;
+    }
+    ParallelBatch batch = {.compiled_expr=compiled_expr, .columns=columns, .output=output, .ranges=ranges, .workers_count=workers_count};
+    for (uint32_t i=0; i < workers_count; i++) { // Chunk aligned, evenly sized ranges.
+        atomic_init(&ranges[i].next_row, (chunks_count * i / workers_count) * EVAL_PARALLEL_CHUNK_LEN);
+        ranges[i].end_row = MIN((chunks_count * (i+1) / workers_count) * EVAL_PARALLEL_CHUNK_LEN, rows_count);
+    }
+    STATS_ADD(SC_BATCH_ROWS, rows_count);
+    STATS_PHASE_START(eval_start_ns); // Wall time of the calling thread, the workers are not counted separately.
+    uint32_t started_count = 1;
+    for (; started_count < workers_count; started_count++) {
+        workers[started_count] = (ParallelWorker){.batch=&batch, .worker_index=started_count};
+        if (pthread_create(&workers[started_count].thread, NULL, parallel_worker_main, &workers[started_count]) != 0) {
+            break; // Fewer threads, the unstarted ranges are stolen.
+        }
+    }
+    DBPRINT("db: parallel batch of %zu rows on %u of %u workers\n", rows_count, started_count, workers_count);
+    run_parallel_worker(&batch, 0, block_stack);
+    for (uint32_t i=1; i < started_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    STATS_PHASE_END(MEVAL_PHASE_EVAL, eval_start_ns);
+    MEVAL_FREE(block_stack);
+    MEVAL_FREE(ranges_allocation);
+    MEVAL_FREE(workers);
+    return true;
+}
+
+bool meval_var_jit_cexpr(MEvalCompiledExpr* compiled_expr, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+        return false;
+    }
+    if (compiled_expr->ops_count == 0) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_TOO_MANY_OPERANDS));
+        return false;
+    }
+    if (compiled_expr->var_slots == NULL && compiled_expr->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is not bound");
+        return false;
+    }
+    if (compiled_expr->registry != NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registered functions are not supported here");
+        return false;
+    }
+#if JIT_SUPPORTED
+    free_jit_code(compiled_expr);
+    const size_t page_size = 4096;
+    const size_t code_size = ((compiled_expr->ops_count+2)*JIT_MAX_BYTES_PER_OP + page_size-1) & ~(page_size-1);
+    void* code = mmap(NULL, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Failed to map JIT memory");
+        return false;
+    }
+    JitBuffer buffer = {.code=code, .code_count=0};
+    if (!gen_jit_code(compiled_expr, &buffer) || mprotect(code, code_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, code_size);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Failed to generate JIT code");
+        return false;
+    }
+    DBPRINT("db: JIT generated %zu bytes for %u ops\n", buffer.code_count, compiled_expr->ops_count);
+    compiled_expr->jit_code = code;
+    compiled_expr->jit_code_size = code_size;
+    memcpy(&compiled_expr->jit_fn, &compiled_expr->jit_code, sizeof(compiled_expr->jit_fn)); // ISO C has no object to function pointer cast.
+    return true;
+#else
+    set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "JIT is not supported by this build");
+    return false;
+#endif
+}
+
+MEvalJitFn meval_cexpr_jit_fn(const MEvalCompiledExpr* compiled_expr) {
+    return compiled_expr == NULL ? NULL : compiled_expr->jit_fn;
+}
+
+uint32_t meval_cexpr_var_count(const MEvalCompiledExpr* compiled_expr) {
+    return compiled_expr == NULL ? 0 : compiled_expr->var_count;
+}
+
+const char* meval_cexpr_var_name(const MEvalCompiledExpr* compiled_expr, uint32_t var_index) {
+    if (compiled_expr == NULL || var_index >= compiled_expr->var_count) {
+        return NULL;
+    }
+    return compiled_expr->var_names[var_index];
+}
+
+void meval_free_compiled_expr(MEvalCompiledExpr** compiled_expr) {
+    if ((*compiled_expr) != NULL) {
+        free_compiled_expr_members(*compiled_expr);
+        const MEvalAllocator allocator = (*compiled_expr)->allocator;
+        allocator_free(&allocator, *compiled_expr);
+        *compiled_expr = NULL;
+    }
+}
+
+void meval_free_variable_arr(MEvalVarArr *variables_array) {
+    if (variables_array->arr_ptr != NULL) {
+        MEVAL_FREE(variables_array->arr_ptr);
+        variables_array->arr_ptr = NULL;
+    }
+    variables_array->elements_count = 0;
+    variables_array->capacity_elements = 0;
+}
+
+/*
+ * Compiled expression cache. Entries are keyed by the expression text and the
+ *   names (in order) of the variables it is evaluated with, as both affect
+ *   how it is compiled and bound. Each entry holds an expression compiled and
+ *   bound for exactly that key, which is never modified afterwards.
+ * Lookups take the read lock, insertions and evictions the write lock. An
+ *   entry is reference counted, so one evicted while being evaluated is only
+ *   freed once that evaluation has finished. Eviction approximates least
+ *   recently used with a CLOCK: a hit sets the entry's own referenced flag,
+ *   and the hand sweeps the entries in insertion slots, giving each flagged
+ *   one a second chance, so evicting costs O(1) amortized.
+ */
+typedef struct MEvalCacheEntry {
+    struct MEvalCacheEntry* next; // Next entry of the same bucket.
+    uint64_t hash;
+    char* input_string;
+    char (*var_names)[MEVAL_VAR_NAME_MAX_LEN]; // The schema 'compiled_expr' is bound to.
+    uint32_t var_count;
+    MEvalCompiledExpr* compiled_expr;
+    atomic_uint ref_count; // One for the cache, plus one per evaluation in progress.
+    atomic_bool referenced; // Hit since the clock hand last passed.
+    uint32_t clock_slot; // Index in 'MEvalCache.clock_entries'.
+} MEvalCacheEntry;
+
+typedef struct MEvalCache {
+    pthread_rwlock_t lock;
+    MEvalCacheEntry** buckets;
+    uint32_t buckets_count; // Power of two.
+    uint32_t entries_count;
+    uint32_t capacity;
+    MEvalCacheEntry** clock_entries; // 'entries_count' used of 'capacity'.
+    uint32_t clock_hand;
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+    atomic_uint_fast64_t evictions;
+} MEvalCache;
+
+static uint64_t hash_cache_key(const char* input_string, const MEvalVarArr variables) {
+    /* FNV-1a over the text, then each variable name (including its terminator) */
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = input_string; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+    }
+    for (uint32_t i=0; i < variables.elements_count; i++) {
+        const char* name = variables.arr_ptr[i].name;
+        for (uint32_t char_index=0; char_index < MEVAL_VAR_NAME_MAX_LEN; char_index++) {
+            hash = (hash ^ (uint8_t)name[char_index]) * 1099511628211ULL;
+            if (name[char_index] == '\0') {
+                break;
+            }
+        }
+    }
+    return hash;
+}
+
+static bool cache_entry_matches(const MEvalCacheEntry* entry, uint64_t hash, const char* input_string, const MEvalVarArr variables) {
+    if (entry->hash != hash || entry->var_count != variables.elements_count || strcmp(entry->input_string, input_string) != 0) {
+        return false;
+    }
+    for (uint32_t i=0; i < entry->var_count; i++) {
+        if (strncmp(entry->var_names[i], variables.arr_ptr[i].name, MEVAL_VAR_NAME_MAX_LEN) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static MEvalCacheEntry** find_cache_entry(MEvalCache* cache, uint64_t hash, const char* input_string, const MEvalVarArr variables) {
+    /* Returns the link pointing at the matching entry, or at the end of the bucket. Lock must be held */
+    MEvalCacheEntry** link = &cache->buckets[hash & (cache->buckets_count-1)];
+    while (*link != NULL && !cache_entry_matches(*link, hash, input_string, variables)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void release_cache_entry(MEvalCacheEntry* entry) {
+    if (atomic_fetch_sub(&entry->ref_count, 1) != 1) {
+        return;
+    }
+    meval_free_compiled_expr(&entry->compiled_expr);
+    MEVAL_FREE(entry->input_string);
+    MEVAL_FREE(entry->var_names);
+    MEVAL_FREE(entry);
+}
+
+static MEvalCacheEntry* new_cache_entry(uint64_t hash, const char* input_string, const MEvalVarArr variables, MEvalError* output_error) {
+    /* Compiles and binds 'input_string' for 'variables'. Returns NULL, with 'output_error' set, on failure */
+    MEvalCacheEntry* entry = MEVAL_MALLOC(sizeof(MEvalCacheEntry));
+    if (entry == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(entry, 0, sizeof(MEvalCacheEntry));
+    entry->hash = hash;
+    entry->var_count = variables.elements_count;
+    atomic_init(&entry->ref_count, 1);
+    atomic_init(&entry->referenced, false);
+    size_t input_string_char_count = strlen(input_string);
+    entry->input_string = MEVAL_MALLOC(input_string_char_count+1);
+    entry->var_names = MEVAL_MALLOC((size_t)MAX(entry->var_count, 1)*MEVAL_VAR_NAME_MAX_LEN);
+    entry->compiled_expr = MEVAL_MALLOC(sizeof(MEvalCompiledExpr));
+    if (entry->input_string == NULL || entry->var_names == NULL || entry->compiled_expr == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        release_cache_entry(entry);
+        return NULL;
+    }
+    memcpy(entry->input_string, input_string, input_string_char_count+1);
+    for (uint32_t i=0; i < entry->var_count; i++) {
+        snprintf(entry->var_names[i], MEVAL_VAR_NAME_MAX_LEN, "%s", variables.arr_ptr[i].name);
+    }
+    memset(entry->compiled_expr, 0, sizeof(MEvalCompiledExpr));
+    entry->compiled_expr->allocator = default_allocator;
+    // Compiled the same way as 'meval_var', where the variables also decide how identifiers are lexed.
+    meval_internal_compile_cexpr(input_string, true, variables, NULL, entry->compiled_expr, output_error);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        release_cache_entry(entry);
+        return NULL;
+    }
+    MEvalCompiledExpr* compiled_expr = entry->compiled_expr;
+    compiled_expr->var_slots = MEVAL_MALLOC(MAX(compiled_expr->var_count, 1)*sizeof(uint32_t));
+    if (compiled_expr->var_slots == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        release_cache_entry(entry);
+        return NULL;
+    }
+    if (!resolve_var_slots(compiled_expr->var_names, compiled_expr->var_count, variables, compiled_expr->var_slots)) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_USE_OF_UNDEFINED_VAR));
+        release_cache_entry(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+static uint32_t evict_cache_entry(MEvalCache* cache) {
+    /* Removes the first entry from the hand on not hit since the hand last passed, and returns its slot. Only called when full, write lock must be held */
+    MEvalCacheEntry* victim = NULL;
+    while (victim == NULL) {
+        MEvalCacheEntry* entry = cache->clock_entries[cache->clock_hand];
+        if (atomic_exchange_explicit(&entry->referenced, false, memory_order_relaxed)) {
+            cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+        } else {
+            victim = entry;
+        }
+    }
+    MEvalCacheEntry** link = &cache->buckets[victim->hash & (cache->buckets_count-1)];
+    while (*link != victim) {
+        link = &(*link)->next;
+    }
+    *link = victim->next;
+    cache->entries_count--;
+    cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+    atomic_fetch_add_explicit(&cache->evictions, 1, memory_order_relaxed);
+    const uint32_t slot = victim->clock_slot;
+    release_cache_entry(victim);
+    return slot;
+}
+
+static MEvalCacheEntry* acquire_cache_entry(MEvalCache* cache, const char* input_string, const MEvalVarArr variables, MEvalError* output_error) {
+    /* Returns the entry for the key, compiling and inserting it if needed. Must be passed to 'release_cache_entry' */
+    const uint64_t hash = hash_cache_key(input_string, variables);
+    pthread_rwlock_rdlock(&cache->lock);
+    MEvalCacheEntry* entry = *find_cache_entry(cache, hash, input_string, variables);
+    if (entry != NULL) {
+        atomic_fetch_add(&entry->ref_count, 1);
+        if (!atomic_load_explicit(&entry->referenced, memory_order_relaxed)) { // Only written once per sweep, not on every hit.
+            atomic_store_explicit(&entry->referenced, true, memory_order_relaxed);
+        }
+    }
+    pthread_rwlock_unlock(&cache->lock);
+    if (entry != NULL) {
+        atomic_fetch_add_explicit(&cache->hits, 1, memory_order_relaxed);
+        return entry;
+    }
+    atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+
+    // Compiled without holding the lock, another thread may insert the same key meanwhile.
+    MEvalCacheEntry* new_entry = new_cache_entry(hash, input_string, variables, output_error);
+    if (new_entry == NULL) {
+        return NULL;
+    }
+    pthread_rwlock_wrlock(&cache->lock);
+    MEvalCacheEntry** link = find_cache_entry(cache, hash, input_string, variables);
+    if (*link != NULL) {
+        entry = *link;
+        atomic_fetch_add(&entry->ref_count, 1);
+        pthread_rwlock_unlock(&cache->lock);
+        release_cache_entry(new_entry);
+        return entry;
+    }
+    new_entry->clock_slot = cache->entries_count;
+    if (cache->entries_count >= cache->capacity) {
+        new_entry->clock_slot = evict_cache_entry(cache);
+        link = find_cache_entry(cache, hash, input_string, variables); // Eviction may have changed the bucket.
+    }
+    cache->clock_entries[new_entry->clock_slot] = new_entry;
+    atomic_fetch_add(&new_entry->ref_count, 1); // One for the cache, one for the caller.
+    *link = new_entry;
+    cache->entries_count++;
+    pthread_rwlock_unlock(&cache->lock);
+    return new_entry;
+}
+
+MEvalCache* meval_cache_create(uint32_t capacity, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (capacity == 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Cache capacity must not be 0");
+        return NULL;
+    }
+    MEvalCache* cache = MEVAL_MALLOC(sizeof(MEvalCache));
+    if (cache == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(cache, 0, sizeof(MEvalCache));
+    cache->capacity = capacity;
+    cache->buckets_count = 1;
+    while (cache->buckets_count < capacity && cache->buckets_count < (UINT32_C(1) << 30)) {
+        cache->buckets_count <<= 1;
+    }
+    cache->buckets = MEVAL_MALLOC(cache->buckets_count*sizeof(MEvalCacheEntry*));
+    cache->clock_entries = MEVAL_MALLOC((size_t)capacity*sizeof(MEvalCacheEntry*));
+    if (cache->buckets == NULL || cache->clock_entries == NULL || pthread_rwlock_init(&cache->lock, NULL) != 0) {
+        MEVAL_FREE(cache->buckets);
+        MEVAL_FREE(cache->clock_entries);
+        MEVAL_FREE(cache);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(cache->buckets, 0, cache->buckets_count*sizeof(MEvalCacheEntry*));
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->evictions, 0);
+    return cache;
+}
+
+double meval_var_cached(MEvalCache* cache, const char* input_string, const MEvalVarArr variables, MEvalError* error) {
+    // Reset the error object to a known state.
+    error->type = MEVAL_NO_ERROR;
+    error->char_index = 0;
+    memset(error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (cache == NULL || input_string == NULL) {
+        return meval_var(input_string, variables, error); // Reports the error, or works without a cache.
+    }
+    MEvalCacheEntry* entry = acquire_cache_entry(cache, input_string, variables, error);
+    if (entry == NULL) {
+        return 0;
+    }
+    const MEvalCompiledExpr* compiled_expr = entry->compiled_expr;
+    double output = 0;
+    double local_scratch[EVAL_LOCAL_SCRATCH_COUNT];
+    double* scratch = acquire_scratch(compiled_expr, &default_allocator, local_scratch);
+    if (scratch == NULL) {
+        set_error(error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+    } else {
+        for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+            scratch[var_id] = variables.arr_ptr[compiled_expr->var_slots[var_id]].value;
+        }
+        output = run_eval_bytecode(compiled_expr, scratch, scratch + compiled_expr->var_count);
+        release_scratch(scratch, &default_allocator, local_scratch);
+    }
+    release_cache_entry(entry);
+    return output;
+}
+
+MEvalCacheStats meval_cache_stats(MEvalCache* cache) {
+    MEvalCacheStats stats = {0};
+    if (cache == NULL) {
+        return stats;
+    }
+    stats.hits = atomic_load_explicit(&cache->hits, memory_order_relaxed);
+    stats.misses = atomic_load_explicit(&cache->misses, memory_order_relaxed);
+    stats.evictions = atomic_load_explicit(&cache->evictions, memory_order_relaxed);
+    pthread_rwlock_rdlock(&cache->lock);
+    stats.entries_count = cache->entries_count;
+    pthread_rwlock_unlock(&cache->lock);
+    stats.capacity = cache->capacity;
+    return stats;
+}
+
+void meval_cache_clear(MEvalCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    pthread_rwlock_wrlock(&cache->lock);
+    for (uint32_t bucket=0; bucket < cache->buckets_count; bucket++) {
+        MEvalCacheEntry* entry = cache->buckets[bucket];
+        while (entry != NULL) {
+            MEvalCacheEntry* next = entry->next;
+            release_cache_entry(entry);
+            entry = next;
+        }
+        cache->buckets[bucket] = NULL;
+    }
+    cache->entries_count = 0;
+    cache->clock_hand = 0;
+    pthread_rwlock_unlock(&cache->lock);
+}
+
+void meval_cache_free(MEvalCache** cache) {
+    if ((*cache) != NULL) {
+        meval_cache_clear(*cache);
+        pthread_rwlock_destroy(&(*cache)->lock);
+        MEVAL_FREE((*cache)->buckets);
+        MEVAL_FREE((*cache)->clock_entries);
+        MEVAL_FREE(*cache);
+        *cache = NULL;
+    }
+}
+
+/*
+ * Multi-expression programs. The bytecode of every expression is turned into
+ *   one DAG, where each node is an operation on earlier nodes. Nodes are
+ *   hash-consed (an identical operation on identical nodes is the same node),
+ *   so a subexpression shared between (or within) expressions is computed
+ *   once. Every built-in function is pure, which makes this safe. Jumps are
+ *   ignored, so both branches of 'if', '&' and '|' are nodes.
+ * Nodes are created in evaluation order, evaluating a program is one pass over
+ *   them, each writing its own register.
+ */
+typedef struct {
+    uint8_t op; // 'enum OPCODE', never OP_END.
+    uint32_t a; // Operand node of functions, var_id of OP_VAR, start of the operand nodes in 'call_args' for n-ary functions.
+    uint32_t b; // Second operand node of binary functions, arguments count of n-ary functions.
+    double number; // OP_NUMBER only.
+} ProgramNode;
+
+typedef struct MEvalProgram {
+    ProgramNode* nodes;
+    uint32_t nodes_count;
+    uint32_t* call_args; // Operand nodes of n-ary function nodes.
+    uint32_t call_args_count;
+    uint32_t* output_nodes; // Node holding the value of each expression.
+    uint32_t outputs_count;
+    char (*var_names)[MEVAL_VAR_NAME_MAX_LEN]; // Distinct variables of every expression, indexed by var_id.
+    uint32_t var_count;
+    uint32_t* var_slots; // NULL until 'meval_program_bind' succeeds.
+} MEvalProgram;
+
+typedef struct {
+    MEvalProgram* program;
+    uint32_t* table; // Node index + 1, 0 for an empty slot.
+    uint32_t table_mask;
+} ProgramBuilder;
+
+static uint64_t hash_program_node(const MEvalProgram* program, const ProgramNode* node) {
+    /* N-ary function nodes are hashed by their operand nodes, not by where those are stored */
+    uint64_t number_bits = 0;
+    memcpy(&number_bits, &node->number, sizeof(number_bits));
+    uint64_t hash = node->op * 0x9E3779B97F4A7C15ULL;
+    if (node->op >= OP_NARY_FN) {
+        for (uint32_t i=0; i < node->b; i++) {
+            hash = (hash ^ program->call_args[node->a + i]) * 0xBF58476D1CE4E5B9ULL;
+        }
+    } else {
+        hash = (hash ^ node->a) * 0xBF58476D1CE4E5B9ULL;
+    }
+    hash = (hash ^ node->b) * 0x94D049BB133111EBULL;
+    hash = (hash ^ number_bits) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 31);
+}
+
+static bool program_nodes_equal(const MEvalProgram* program, const ProgramNode* node_a, const ProgramNode* node_b) {
+    /* Numbers are compared bitwise, so 0 and -0 stay apart */
+    if (node_a->op >= OP_NARY_FN && node_a->op == node_b->op && node_a->b == node_b->b) {
+        return memcmp(&program->call_args[node_a->a], &program->call_args[node_b->a], node_a->b*sizeof(uint32_t)) == 0;
+    }
+    return node_a->op == node_b->op && node_a->a == node_b->a && node_a->b == node_b->b
+        && memcmp(&node_a->number, &node_b->number, sizeof(double)) == 0;
+}
+
+static uint32_t intern_program_node(ProgramBuilder* builder, ProgramNode node) {
+    /*
+     * Returns the index of the node equal to 'node', adding it if there is none. The table is sized so it never fills.
+     * The operand nodes of an n-ary function node must already be at the end of 'call_args', they are only kept if it is added.
+     */
+    uint32_t table_index = hash_program_node(builder->program, &node) & builder->table_mask;
+    while (builder->table[table_index] != 0) {
+        uint32_t node_index = builder->table[table_index] - 1;
+        if (program_nodes_equal(builder->program, &builder->program->nodes[node_index], &node)) {
+            return node_index;
+        }
+        table_index = (table_index + 1) & builder->table_mask;
+    }
+    if (node.op >= OP_NARY_FN) {
+        builder->program->call_args_count += node.b;
+    }
+    uint32_t node_index = builder->program->nodes_count++;
+    builder->program->nodes[node_index] = node;
+    builder->table[table_index] = node_index + 1;
+    return node_index;
+}
+
+static uint32_t add_program_var(MEvalProgram* program, const char* var_name) {
+    /* Returns the program var_id of 'var_name', 'program->var_names' must have room for it */
+    for (uint32_t var_id=0; var_id < program->var_count; var_id++) {
+        if (strncmp(program->var_names[var_id], var_name, MEVAL_VAR_NAME_MAX_LEN) == 0) {
+            return var_id;
+        }
+    }
+    snprintf(program->var_names[program->var_count], MEVAL_VAR_NAME_MAX_LEN, "%s", var_name);
+    return program->var_count++;
+}
+
+static bool add_program_expr(ProgramBuilder* builder, const MEvalCompiledExpr* compiled_expr, uint32_t* output_node) {
+    /* Adds the nodes of 'compiled_expr', by running its bytecode on a stack of node indices. Returns false on a failed allocation */
+    uint32_t* node_stack = MEVAL_MALLOC(MAX(compiled_expr->max_stack_depth, 1)*sizeof(uint32_t));
+    uint32_t* var_ids = MEVAL_MALLOC(MAX(compiled_expr->var_count, 1)*sizeof(uint32_t));
+    if (node_stack == NULL || var_ids == NULL) {
+        MEVAL_FREE(node_stack);
+        MEVAL_FREE(var_ids);
+        return false;
+    }
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+        var_ids[var_id] = add_program_var(builder->program, compiled_expr->var_names[var_id]);
+    }
+    const double* numbers = compiled_expr->numbers;
+    const uint32_t* operands = compiled_expr->operands;
+    uint32_t stack_count = 0;
+    for (uint32_t ops_index = 0; ops_index < compiled_expr->ops_count; ops_index++) {
+        const uint8_t op = compiled_expr->ops[ops_index];
+        ProgramNode node = {.op=op, .a=0, .b=0, .number=0};
+        if (op == OP_NUMBER) {
+            node.number = *numbers++;
+        } else if (op == OP_VAR) {
+            node.a = var_ids[*operands++];
+        } else if (op < OP_BINARY_FN) {
+            node.a = node_stack[--stack_count];
+        } else if (is_jump_op(op)) { // Both branches are evaluated.
+            operands += JUMP_OPERANDS_COUNT;
+            continue;
+        } else if (op >= OP_NARY_FN) {
+            node.b = op == OP_SELECT ? 3 : *operands++;
+            stack_count -= node.b;
+            node.a = builder->program->call_args_count;
+            memcpy(&builder->program->call_args[node.a], &node_stack[stack_count], node.b*sizeof(uint32_t));
+        } else {
+            node.b = node_stack[--stack_count];
+            node.a = node_stack[--stack_count];
+        }
+        node_stack[stack_count++] = intern_program_node(builder, node);
+    }
+    *output_node = node_stack[0];
+    MEVAL_FREE(node_stack);
+    MEVAL_FREE(var_ids);
+    return true;
+}
+
+static void eval_program(const MEvalProgram* program, const double* values, double* registers, double* outputs) {
+    /*
+     * 'registers' must hold 'nodes_count' doubles, 'values' is indexed by bound schema slot.
+     * Unary nodes pass register 0 as their unused 'b', node 0 is never a function so it is always written first.
+     */
+    for (uint32_t node_index = 0; node_index < program->nodes_count; node_index++) {
+        const ProgramNode* node = &program->nodes[node_index];
+        double result = 0;
+        if (node->op == OP_NUMBER) {
+            result = node->number;
+        } else if (node->op == OP_VAR) {
+            result = values[program->var_slots[node->a]];
+        } else if (node->op >= OP_NARY_FN) {
+            double args[CALL_MAX_ARGS_COUNT];
+            for (uint32_t i=0; i < node->b; i++) {
+                args[i] = registers[program->call_args[node->a + i]];
+            }
+            result = get_nary_fn(node->op)->fnptr(args, node->b);
+        } else {
+            result = eval_fn_op(node->op, registers[node->a], registers[node->b]);
+        }
+        registers[node_index] = result;
+    }
+    for (uint32_t i=0; i < program->outputs_count; i++) {
+        outputs[i] = registers[program->output_nodes[i]];
+    }
+}
+
+MEvalProgram* meval_program_compile(const char* const* input_strings, uint32_t expressions_count, uint32_t* output_error_expr_index, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+    if (output_error_expr_index != NULL) {
+        *output_error_expr_index = 0;
+    }
+
+    if (expressions_count == 0) {
+        set_error(output_error, MEVAL_LEX_ERROR, 0, "No Input Given");
+        return NULL;
+    }
+    MEvalProgram* program = MEVAL_MALLOC(sizeof(MEvalProgram));
+    MEvalCompiledExpr* compiled_exprs = MEVAL_MALLOC(expressions_count*sizeof(MEvalCompiledExpr));
+    if (program == NULL || compiled_exprs == NULL) {
+        MEVAL_FREE(program);
+        MEVAL_FREE(compiled_exprs);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(program, 0, sizeof(MEvalProgram));
+    memset(compiled_exprs, 0, expressions_count*sizeof(MEvalCompiledExpr));
+
+    // Every expression is compiled on its own first, to find the most nodes and variables there could be.
+    MEvalVarArr empty_variable_array = {0};
+    size_t max_nodes_count = 0;
+    size_t max_var_count = 0;
+    uint32_t compiled_count = 0;
+    for (; compiled_count < expressions_count; compiled_count++) {
+        compiled_exprs[compiled_count].allocator = default_allocator;
+        meval_internal_compile_cexpr(input_strings[compiled_count], true, empty_variable_array, NULL, &compiled_exprs[compiled_count], output_error);
+        if (output_error->type != MEVAL_NO_ERROR) {
+            if (output_error_expr_index != NULL) {
+                *output_error_expr_index = compiled_count;
+            }
+            compiled_count++; // Its members still need freeing.
+            break;
+        }
+        max_nodes_count += compiled_exprs[compiled_count].ops_count;
+        max_var_count += compiled_exprs[compiled_count].var_count;
+    }
+
+    ProgramBuilder builder = {.program=program, .table=NULL, .table_mask=0};
+    if (output_error->type == MEVAL_NO_ERROR) {
+        size_t table_count = 2;
+        while (table_count < 2*max_nodes_count) {
+            table_count <<= 1;
+        }
+        builder.table_mask = table_count-1;
+        builder.table = MEVAL_MALLOC(table_count*sizeof(uint32_t));
+        program->nodes = MEVAL_MALLOC(MAX(max_nodes_count, 1)*sizeof(ProgramNode));
+        program->call_args = MEVAL_MALLOC(MAX(max_nodes_count, 1)*sizeof(uint32_t)); // A node is the argument of at most one node per expression.
+        program->var_names = MEVAL_MALLOC(MAX(max_var_count, 1)*MEVAL_VAR_NAME_MAX_LEN);
+        program->output_nodes = MEVAL_MALLOC(expressions_count*sizeof(uint32_t));
+        program->outputs_count = expressions_count;
+        bool success = max_nodes_count < UINT32_MAX && builder.table != NULL && program->nodes != NULL && program->call_args != NULL && program->var_names != NULL && program->output_nodes != NULL;
+        if (success) {
+            memset(builder.table, 0, table_count*sizeof(uint32_t));
+        }
+        for (uint32_t i=0; i < expressions_count && success; i++) {
+            success = add_program_expr(&builder, &compiled_exprs[i], &program->output_nodes[i]);
+        }
+        if (!success) {
+            set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        }
+        DBPRINT("db: program of %u expressions, %zu nodes deduplicated to %u\n", expressions_count, max_nodes_count, program->nodes_count);
+    }
+    MEVAL_FREE(builder.table);
+    for (uint32_t i=0; i < compiled_count; i++) {
+        free_compiled_expr_members(&compiled_exprs[i]);
+    }
+    MEVAL_FREE(compiled_exprs);
+    if (output_error->type != MEVAL_NO_ERROR) {
+        meval_free_program(&program);
+        return NULL;
+    }
+    return program;
+}
+
+bool meval_program_bind(MEvalProgram* program, const MEvalVarArr variables, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (program == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Program is empty");
+        return false;
+    }
+    if (program->var_slots == NULL) {
+        program->var_slots = MEVAL_MALLOC(MAX(program->var_count, 1)*sizeof(uint32_t));
+        if (program->var_slots == NULL) {
+            set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+            return false;
+        }
+    }
+    if (!resolve_var_slots(program->var_names, program->var_count, variables, program->var_slots)) {
+        MEVAL_FREE(program->var_slots);
+        program->var_slots = NULL;
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_USE_OF_UNDEFINED_VAR));
+        return false;
+    }
+    return true;
+}
+
+bool meval_program_eval_bound(const MEvalProgram* program, const double* values, double* outputs, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    if (program == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Program is empty");
+        return false;
+    }
+    if (program->var_slots == NULL && program->var_count > 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Program is not bound");
+        return false;
+    }
+    double local_registers[EVAL_LOCAL_SCRATCH_COUNT];
+    double* registers = program->nodes_count <= EVAL_LOCAL_SCRATCH_COUNT ? local_registers : MEVAL_MALLOC(program->nodes_count*sizeof(double));
+    if (registers == NULL) {
+        set_error(output_error, MEVAL_PARSE_ERROR, 0, get_eval_error_str(EE_FAILED_MEM_ALLOCATION));
+        return false;
+    }
+    eval_program(program, values, registers, outputs);
+    if (registers != local_registers) {
+        MEVAL_FREE(registers);
+    }
+    return true;
+}
+
+uint32_t meval_program_var_count(const MEvalProgram* program) {
+    return program == NULL ? 0 : program->var_count;
+}
+
+const char* meval_program_var_name(const MEvalProgram* program, uint32_t var_index) {
+    if (program == NULL || var_index >= program->var_count) {
+        return NULL;
+    }
+    return program->var_names[var_index];
+}
+
+uint32_t meval_program_node_count(const MEvalProgram* program) {
+    return program == NULL ? 0 : program->nodes_count;
+}
+
+void meval_free_program(MEvalProgram** program) {
+    if ((*program) != NULL) {
+        MEVAL_FREE((*program)->nodes);
+        MEVAL_FREE((*program)->call_args);
+        MEVAL_FREE((*program)->output_nodes);
+        MEVAL_FREE((*program)->var_names);
+        MEVAL_FREE((*program)->var_slots);
+        MEVAL_FREE(*program);
+        *program = NULL;
+    }
+}
+
+/*
+ * Compiled expression files. A file holds a header, an index of record
+ *   offsets, then one record per expression:
+ *   [CexprFileRecord][numbers][operands][var_names][ops, OP_END included]
+ *   Every record starts 8 byte aligned, so its pools can be used in place
+ *   from a read only mapping of the file. Opcodes index 'unary_fns' and
+ *   'binary_fns', so files only load into a build with the same function tables.
+ */
+#define CEXPR_FILE_MAGIC "MEVALCX"
+#define CEXPR_FILE_VERSION 3 // 2 added n-ary functions, 3 jumps.
+#define CEXPR_FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // CEXPR_FILE_BYTE_ORDER as written by the writer.
+    uint32_t unary_fn_count;
+    uint32_t binary_fn_count;
+    uint32_t nary_fn_count;
+    uint32_t var_name_max_len;
+    uint32_t expressions_count;
+    uint32_t reserved; // Keeps the record offsets 8 byte aligned.
+    // Followed by 'expressions_count' uint64_t record offsets, from the start of the file.
+} CexprFileHeader;
+
+typedef struct {
+    uint32_t numbers_count;
+    uint32_t operands_count;
+    uint32_t ops_count;
+    uint32_t var_count;
+    uint32_t max_stack_depth; // Informational, the loader measures it from the bytecode.
+    uint32_t reserved;
+} CexprFileRecord;
+
+typedef struct MEvalCompiledFile {
+    void* mapping;
+    size_t mapping_size;
+    MEvalCompiledExpr* compiled_exprs; // Point into 'mapping', only 'var_slots' and JIT code are their own.
+    uint32_t expressions_count;
+} MEvalCompiledFile;
+
+static size_t align_cexpr_record(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+static size_t get_cexpr_record_size(const CexprFileRecord* record) {
+    return align_cexpr_record(sizeof(CexprFileRecord) + (size_t)record->numbers_count*sizeof(double) + (size_t)record->operands_count*sizeof(uint32_t)
+        + (size_t)record->var_count*MEVAL_VAR_NAME_MAX_LEN + (size_t)record->ops_count+1);
+}
+
+static bool write_cexpr_file_zeros(FILE* file, size_t count) {
+    static const unsigned char zeros[8] = {0};
+    return count == 0 || fwrite(zeros, 1, count, file) == count;
+}
+
+bool meval_cexpr_file_write(const char* path, const MEvalCompiledExpr* const* compiled_exprs, uint32_t expressions_count, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    for (uint32_t i=0; i < expressions_count; i++) {
+        if (compiled_exprs[i] == NULL || compiled_exprs[i]->ops_count == 0) {
+            set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression is empty");
+            return false;
+        }
+        if (compiled_exprs[i]->registry != NULL) { // Registry indices mean nothing to another process.
+            set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Registered functions are not supported here");
+            return false;
+        }
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Failed to open the file");
+        return false;
+    }
+    CexprFileHeader header = {.version=CEXPR_FILE_VERSION, .byte_order=CEXPR_FILE_BYTE_ORDER, .unary_fn_count=UNARY_FN_COUNT,
+        .binary_fn_count=BINARY_FN_COUNT, .nary_fn_count=NARY_FN_COUNT, .var_name_max_len=MEVAL_VAR_NAME_MAX_LEN, .expressions_count=expressions_count};
+    memcpy(header.magic, CEXPR_FILE_MAGIC, sizeof(header.magic));
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    const size_t index_size = (size_t)expressions_count*sizeof(uint64_t);
+    uint64_t record_offset = align_cexpr_record(sizeof(header) + index_size);
+    for (uint32_t i=0; i < expressions_count && success; i++) {
+        const MEvalCompiledExpr* compiled_expr = compiled_exprs[i];
+        const CexprFileRecord record = {.numbers_count=compiled_expr->numbers_count, .operands_count=compiled_expr->operands_count,
+            .ops_count=compiled_expr->ops_count, .var_count=compiled_expr->var_count, .max_stack_depth=compiled_expr->max_stack_depth};
+        success = fwrite(&record_offset, sizeof(record_offset), 1, file) == 1;
+        record_offset += get_cexpr_record_size(&record);
+    }
+    success = success && write_cexpr_file_zeros(file, align_cexpr_record(sizeof(header) + index_size) - (sizeof(header) + index_size));
+
+    for (uint32_t i=0; i < expressions_count && success; i++) {
+        const MEvalCompiledExpr* compiled_expr = compiled_exprs[i];
+        const CexprFileRecord record = {.numbers_count=compiled_expr->numbers_count, .operands_count=compiled_expr->operands_count,
+            .ops_count=compiled_expr->ops_count, .var_count=compiled_expr->var_count, .max_stack_depth=compiled_expr->max_stack_depth};
+        const size_t unpadded_size = sizeof(record) + record.numbers_count*sizeof(double) + record.operands_count*sizeof(uint32_t)
+            + (size_t)record.var_count*MEVAL_VAR_NAME_MAX_LEN + record.ops_count+1;
+        success = fwrite(&record, sizeof(record), 1, file) == 1
+            && (record.numbers_count == 0 || fwrite(compiled_expr->numbers, sizeof(double), record.numbers_count, file) == record.numbers_count)
+            && (record.operands_count == 0 || fwrite(compiled_expr->operands, sizeof(uint32_t), record.operands_count, file) == record.operands_count)
+            && (record.var_count == 0 || fwrite(compiled_expr->var_names, MEVAL_VAR_NAME_MAX_LEN, record.var_count, file) == record.var_count)
+            && fwrite(compiled_expr->ops, 1, record.ops_count+1, file) == record.ops_count+1
+            && write_cexpr_file_zeros(file, get_cexpr_record_size(&record) - unpadded_size);
+    }
+    if (fclose(file) != 0 || !success) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Failed to write the file");
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    uint8_t op; // OP_SKIP_IF_x or OP_JUMP_IF_FALSE, then OP_JUMP once the 'if' is past its 'a'.
+    uint32_t floor; // Stack values below this are operands it has not used yet.
+    const uint32_t* target; // Operands of its pending jump.
+} OpenBranch;
+
+static bool is_jump_target(const uint32_t* target, uint32_t ops_index, uint32_t numbers_index, uint32_t operands_index) {
+    return target[0] == ops_index && target[1] == numbers_index && target[2] == operands_index;
+}
+
+static bool verify_cexpr_record(MEvalCompiledExpr* compiled_expr) {
+    /*
+     * Checks that the bytecode of a loaded record stays within its pools, as compiled bytecode always does. Sets 'max_stack_depth'.
+     * Jumps must be laid out as 'gen_bytecode' does (see 'enum OPCODE'), with
+     *   every target where the jump lands when ignoring jumps, and no
+     *   instruction using an operand of an unfinished '&', '|' or 'if'. Every
+     *   path through the jumps then stays within the pools as well.
+     */
+    for (uint32_t var_id=0; var_id < compiled_expr->var_count; var_id++) {
+        if (memchr(compiled_expr->var_names[var_id], '\0', MEVAL_VAR_NAME_MAX_LEN) == NULL) {
+            return false;
+        }
+    }
+    OpenBranch* branches = MEVAL_MALLOC(MAX(compiled_expr->ops_count, 1)*sizeof(OpenBranch));
+    if (branches == NULL) {
+        return false;
+    }
+    uint32_t branches_count = 0;
+    uint32_t numbers_index = 0;
+    uint32_t operands_index = 0;
+    uint32_t stack_depth = 0;
+    uint32_t max_stack_depth = 0;
+    bool is_valid = true;
+    for (uint32_t ops_index = 0; ops_index < compiled_expr->ops_count && is_valid; ops_index++) {
+        const uint8_t op = compiled_expr->ops[ops_index];
+        OpenBranch* branch = branches_count > 0 ? &branches[branches_count-1] : NULL;
+        const uint32_t floor = branch != NULL ? branch->floor : 0;
+        if (op == OP_NUMBER) {
+            numbers_index++;
+            stack_depth++;
+        } else if (op == OP_VAR) {
+            is_valid = operands_index < compiled_expr->operands_count && compiled_expr->operands[operands_index++] < compiled_expr->var_count;
+            stack_depth++;
+        } else if (op < OP_BINARY_FN) {
+            is_valid = stack_depth >= floor+1;
+        } else if (op < OP_NARY_FN) {
+            const bool ends_branch = branch != NULL && stack_depth == floor+1
+                && ((op == OP_BINARY_FN + BFN_AND && branch->op == OP_SKIP_IF_FALSE) || (op == OP_BINARY_FN + BFN_OR && branch->op == OP_SKIP_IF_TRUE));
+            is_valid = ends_branch || stack_depth >= floor+2;
+            stack_depth--;
+            if (ends_branch) {
+                is_valid = is_jump_target(branch->target, ops_index+1, numbers_index, operands_index);
+                branches_count--;
+            }
+        } else if (op < OP_END) {
+            is_valid = operands_index < compiled_expr->operands_count;
+            const uint32_t args_count = is_valid ? compiled_expr->operands[operands_index++] : 0;
+            const NaryFn* fn = &nary_fns[op - OP_NARY_FN];
+            is_valid = is_valid && args_count >= fn->min_args_count && args_count <= fn->max_args_count && stack_depth >= floor + args_count;
+            stack_depth -= args_count - 1;
+        } else if (is_jump_op(op)) {
+            is_valid = operands_index + JUMP_OPERANDS_COUNT <= compiled_expr->operands_count && stack_depth >= floor+1;
+            const uint32_t* target = &compiled_expr->operands[operands_index];
+            operands_index += JUMP_OPERANDS_COUNT;
+            if (is_valid && op == OP_JUMP) { // Ends the 'a' of an 'if', where its OP_JUMP_IF_FALSE lands.
+                is_valid = branch != NULL && branch->op == OP_JUMP_IF_FALSE && stack_depth == floor+1
+                    && is_jump_target(branch->target, ops_index+1, numbers_index, operands_index);
+                if (is_valid) {
+                    *branch = (OpenBranch){.op=OP_JUMP, .floor=stack_depth, .target=target};
+                }
+            } else if (is_valid) {
+                branches[branches_count++] = (OpenBranch){.op=op, .floor=stack_depth, .target=target};
+            }
+        } else if (op == OP_SELECT) { // Ends the 'b' of an 'if', where its OP_JUMP lands.
+            is_valid = branch != NULL && branch->op == OP_JUMP && stack_depth == floor+1
+                && is_jump_target(branch->target, ops_index+1, numbers_index, operands_index);
+            stack_depth -= 2;
+            branches_count--;
+        } else {
+            is_valid = false;
+        }
+        max_stack_depth = MAX(max_stack_depth, stack_depth);
+    }
+    MEVAL_FREE(branches);
+    compiled_expr->max_stack_depth = max_stack_depth;
+    return is_valid && branches_count == 0 && stack_depth == 1 && numbers_index == compiled_expr->numbers_count
+        && operands_index == compiled_expr->operands_count && compiled_expr->ops[compiled_expr->ops_count] == OP_END;
+}
+
+static bool load_cexpr_file_records(MEvalCompiledFile* compiled_file) {
+    /* Points a compiled expression at every record of the mapped file. Returns false if the file is malformed */
+    const unsigned char* data = compiled_file->mapping;
+    const size_t size = compiled_file->mapping_size;
+    const uint64_t* record_offsets = (const uint64_t*)(data + sizeof(CexprFileHeader));
+    for (uint32_t i=0; i < compiled_file->expressions_count; i++) {
+        const uint64_t offset = record_offsets[i];
+        if (offset % 8 != 0 || offset > size || size - offset < sizeof(CexprFileRecord)) {
+            return false;
+        }
+        const CexprFileRecord* record = (const CexprFileRecord*)(data + offset);
+        if (record->ops_count == 0 || get_cexpr_record_size(record) > size - offset) {
+            return false;
+        }
+        /* The mapping is read only, but evaluation never writes to the pools */
+        unsigned char* pools = (unsigned char*)(data + offset + sizeof(CexprFileRecord));
+        MEvalCompiledExpr* compiled_expr = &compiled_file->compiled_exprs[i];
+        compiled_expr->numbers = (double*)pools;
+        compiled_expr->numbers_count = record->numbers_count;
+        compiled_expr->operands = (uint32_t*)(pools + record->numbers_count*sizeof(double));
+        compiled_expr->operands_count = record->operands_count;
+        compiled_expr->var_names = (char (*)[MEVAL_VAR_NAME_MAX_LEN])((unsigned char*)compiled_expr->operands + record->operands_count*sizeof(uint32_t));
+        compiled_expr->var_count = record->var_count;
+        compiled_expr->ops = (uint8_t*)compiled_expr->var_names + (size_t)record->var_count*MEVAL_VAR_NAME_MAX_LEN;
+        compiled_expr->ops_count = record->ops_count;
+        compiled_expr->allocator = default_allocator;
+        if (!verify_cexpr_record(compiled_expr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MEvalCompiledFile* meval_cexpr_file_open(const char* path, MEvalError* output_error) {
+    // Reset the error object to a known state.
+    output_error->type = MEVAL_NO_ERROR;
+    output_error->char_index = 0;
+    memset(output_error->message, 0, MEVAL_ERROR_STRING_LEN);
+
+    int file_descriptor = open(path, O_RDONLY);
+    if (file_descriptor < 0) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Failed to open the file");
+        return NULL;
+    }
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(CexprFileHeader)) {
+        close(file_descriptor);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Not a compiled expression file");
+        return NULL;
+    }
+    const size_t mapping_size = file_stat.st_size;
+    void* mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (mapping == MAP_FAILED) {
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Failed to map the file");
+        return NULL;
+    }
+
+    const CexprFileHeader* header = mapping;
+    if (memcmp(header->magic, CEXPR_FILE_MAGIC, sizeof(header->magic)) != 0
+            || (mapping_size - sizeof(CexprFileHeader))/sizeof(uint64_t) < header->expressions_count) {
+        munmap(mapping, mapping_size);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Not a compiled expression file");
+        return NULL;
+    }
+    if (header->version != CEXPR_FILE_VERSION || header->byte_order != CEXPR_FILE_BYTE_ORDER || header->unary_fn_count != UNARY_FN_COUNT
+            || header->binary_fn_count != BINARY_FN_COUNT || header->nary_fn_count != NARY_FN_COUNT || header->var_name_max_len != MEVAL_VAR_NAME_MAX_LEN) {
+        munmap(mapping, mapping_size);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression file is incompatible");
+        return NULL;
+    }
+
+    MEvalCompiledFile* compiled_file = MEVAL_MALLOC(sizeof(MEvalCompiledFile));
+    MEvalCompiledExpr* compiled_exprs = MEVAL_MALLOC(MAX(header->expressions_count, 1)*sizeof(MEvalCompiledExpr));
+    if (compiled_file == NULL || compiled_exprs == NULL) {
+        MEVAL_FREE(compiled_file);
+        MEVAL_FREE(compiled_exprs);
+        munmap(mapping, mapping_size);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Heap allocation failed");
+        return NULL;
+    }
+    memset(compiled_exprs, 0, MAX(header->expressions_count, 1)*sizeof(MEvalCompiledExpr));
+    *compiled_file = (MEvalCompiledFile){.mapping=mapping, .mapping_size=mapping_size, .compiled_exprs=compiled_exprs, .expressions_count=header->expressions_count};
+    if (!load_cexpr_file_records(compiled_file)) {
+        meval_cexpr_file_close(&compiled_file);
+        set_error(output_error, MEVAL_PACKAGING_ERROR, 0, "Compiled expression file is corrupt");
+        return NULL;
+    }
+    return compiled_file;
+}
+
+uint32_t meval_cexpr_file_count(const MEvalCompiledFile* compiled_file) {
+    return compiled_file == NULL ? 0 : compiled_file->expressions_count;
+}
+
+MEvalCompiledExpr* meval_cexpr_file_get(MEvalCompiledFile* compiled_file, uint32_t index) {
+    if (compiled_file == NULL || index >= compiled_file->expressions_count) {
+        return NULL;
+    }
+    return &compiled_file->compiled_exprs[index];
+}
+
+void meval_cexpr_file_close(MEvalCompiledFile** compiled_file) {
+    if ((*compiled_file) != NULL) {
+        for (uint32_t i=0; i < (*compiled_file)->expressions_count; i++) {
+            free_jit_code(&(*compiled_file)->compiled_exprs[i]);
+            allocator_free(&(*compiled_file)->compiled_exprs[i].allocator, (*compiled_file)->compiled_exprs[i].var_slots);
+        }
+        munmap((*compiled_file)->mapping, (*compiled_file)->mapping_size);
+        MEVAL_FREE((*compiled_file)->compiled_exprs);
+        MEVAL_FREE(*compiled_file);
+        *compiled_file = NULL;
+    }
+}
@@ -6,9 +6,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h> // open
+#include <unistd.h> // read, sysconf
+#include <pthread.h>
+#include <math.h> // NAN
 
 #define REPL_INPUT_BUFFER_LEN 128
+#define STREAM_CHUNK_LEN (1 << 20) // Bytes read per batch of lines, a batch grows to fit a longer line.
+#define STREAM_RESULT_MAX_LEN (32 + MEVAL_ERROR_STRING_LEN) // Of one output line.
 #define MIN(a, b) (a < b ? a : b)
+#define MAX(a, b) (a > b ? a : b)
 
 #ifdef MEVAL_DB_ENABLED
 #define DBPRINT(format, ...) printf(format, ##__VA_ARGS__)
@@ -115,9 +123,534 @@ void print_vars(MEvalVarArr vars) {
     }
 }
 
+/*
+ * Streaming mode, '--stream'. Every input line is an expression, optionally
+ *   followed by ';' and its variables in the same 'name=value ...' form as the
+ *   repl. Every input line gives exactly one output line, the result or the
+ *   error, in input order.
+ * The input is read in large chunks into batches of whole lines. The main
+ *   thread fills free batches and writes out finished ones in order, while
+ *   worker threads evaluate the batches, so reading, evaluating and writing
+ *   overlap. There are twice as many batches as workers, so workers rarely
+ *   wait on the main thread. CSV mode runs its rows through the same pipeline.
+ */
+enum STREAM_BATCH_STATE {SB_FREE, SB_READY, SB_EVALUATING, SB_DONE};
+typedef struct {
+    char* text; // Whole lines.
+    size_t text_len;
+    size_t text_capacity;
+    char* output;
+    size_t output_len;
+    size_t output_capacity;
+    double* numbers; // Scratch for the batch function.
+    size_t numbers_capacity;
+    uint32_t failure_count;
+    enum STREAM_BATCH_STATE state;
+} StreamBatch;
+
+typedef bool (*StreamBatchFn)(StreamBatch* batch, void* ctx); // Fills 'batch->output' from 'batch->text', returns false on a fatal error.
+
+typedef struct {
+    int fd;
+    char* carry; // Partial line, read after the last batch's whole lines.
+    size_t carry_len;
+    size_t carry_capacity;
+    bool ended;
+} StreamInput;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t ready_cond; // A batch was filled, or the input ended.
+    pthread_cond_t done_cond; // A batch was evaluated.
+    StreamBatch* batches;
+    uint32_t batches_count;
+    uint64_t filled_count; // Batch 'n' is 'batches[n % batches_count]'.
+    uint64_t taken_count; // Taken by a worker.
+    bool input_ended;
+    StreamBatchFn batch_fn;
+    void* batch_ctx;
+} Stream;
+
+bool reserve_buffer(void** buffer, size_t* capacity, size_t needed, size_t element_size) {
+    /* Grows '*buffer' to at least 'needed' elements, '*capacity' counts elements */
+    if (*buffer != NULL && needed <= *capacity) {
+        return true;
+    }
+    size_t new_capacity = *capacity > 0 ? *capacity : 256;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    void* new_buffer = realloc(*buffer, new_capacity*element_size);
+    if (new_buffer == NULL) {
+        return false;
+    }
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return true;
+}
+
+bool open_stream_input(const char* path, StreamInput* output_input) {
+    /* 'path' of "-" or NULL is stdin */
+    *output_input = (StreamInput){.fd=STDIN_FILENO};
+    if (path != NULL && strcmp(path, "-") != 0) {
+        output_input->fd = open(path, O_RDONLY);
+        if (output_input->fd < 0) {
+            fprintf(stderr, "meval: cannot open '%s': %s\n", path, strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+void close_stream_input(StreamInput* input) {
+    free(input->carry);
+    if (input->fd != STDIN_FILENO) {
+        close(input->fd);
+    }
+}
+
+bool fill_stream_batch(StreamInput* input, StreamBatch* batch) {
+    /*
+     * Fills 'batch' with the partial line carried over from the previous batch, then whole lines read from the input,
+     *   carrying the partial line at the end over to the next batch. Returns false on a read or allocation error.
+     */
+    batch->text_len = 0;
+    if (!reserve_buffer((void**)&batch->text, &batch->text_capacity, input->carry_len + STREAM_CHUNK_LEN + 1, 1)) {
+        return false;
+    }
+    if (input->carry_len > 0) {
+        memcpy(batch->text, input->carry, input->carry_len);
+    }
+    batch->text_len = input->carry_len;
+    input->carry_len = 0;
+    size_t line_search_start = 0;
+    while (true) {
+        if (!reserve_buffer((void**)&batch->text, &batch->text_capacity, batch->text_len + STREAM_CHUNK_LEN + 1, 1)) {
+            return false;
+        }
+        ssize_t read_count = read(input->fd, batch->text + batch->text_len, STREAM_CHUNK_LEN);
+        if (read_count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read_count < 0) {
+            return false;
+        }
+        if (read_count == 0) {
+            input->ended = true;
+            break;
+        }
+        batch->text_len += read_count;
+        if (memchr(batch->text + line_search_start, '\n', batch->text_len - line_search_start) != NULL) {
+            break;
+        }
+        line_search_start = batch->text_len; // A line longer than a chunk, keep reading.
+    }
+    if (!input->ended) {
+        size_t lines_len = batch->text_len;
+        while (batch->text[lines_len-1] != '\n') {
+            lines_len--;
+        }
+        if (!reserve_buffer((void**)&input->carry, &input->carry_capacity, batch->text_len - lines_len, 1)) {
+            return false;
+        }
+        input->carry_len = batch->text_len - lines_len;
+        memcpy(input->carry, batch->text + lines_len, input->carry_len);
+        batch->text_len = lines_len;
+    }
+    batch->text[batch->text_len] = '\0';
+    return true;
+}
+
+char* next_stream_line(char** line, char* text_end) {
+    /* Terminates the line at '*line', dropping any '\r', and moves '*line' on to the next one. Returns the line */
+    char* current_line = *line;
+    char* line_end = memchr(current_line, '\n', text_end - current_line);
+    if (line_end == NULL) {
+        line_end = text_end;
+    }
+    *line_end = '\0';
+    if (line_end > current_line && line_end[-1] == '\r') {
+        line_end[-1] = '\0';
+    }
+    *line = line_end + 1;
+    return current_line;
+}
+
+void eval_stream_line(char* line, StreamBatch* batch) {
+    /* Evaluates one line, appending its result (or error) line to 'batch->output', which must have room for it */
+    MEvalError error;
+    double value = 0;
+    char* vars_start = strchr(line, ';');
+    if (vars_start != NULL) {
+        *vars_start = '\0';
+        vars_start++;
+        MEvalVarArr vars = parse_for_vars(vars_start, strlen(vars_start));
+        value = meval_var(line, vars, &error);
+        meval_free_variable_arr(&vars);
+    } else {
+        value = meval(line, &error);
+    }
+    char* output = batch->output + batch->output_len;
+    int output_len = 0;
+    if (error.type == MEVAL_NO_ERROR) {
+        output_len = snprintf(output, STREAM_RESULT_MAX_LEN, "%.17g\n", value);
+    } else {
+        output_len = snprintf(output, STREAM_RESULT_MAX_LEN, "error: %s\n", error.message);
+        batch->failure_count++;
+    }
+    batch->output_len += MIN(output_len, STREAM_RESULT_MAX_LEN-1);
+}
+
+bool eval_stream_batch(StreamBatch* batch, void* ctx) {
+    (void)ctx;
+    char* line = batch->text;
+    char* text_end = batch->text + batch->text_len;
+    while (line < text_end) {
+        char* current_line = next_stream_line(&line, text_end);
+        if (!reserve_buffer((void**)&batch->output, &batch->output_capacity, batch->output_len + STREAM_RESULT_MAX_LEN, 1)) {
+            return false;
+        }
+        eval_stream_line(current_line, batch);
+    }
+    return true;
+}
+
+void* stream_worker_main(void* arg) {
+    Stream* stream = arg;
+    pthread_mutex_lock(&stream->mutex);
+    while (true) {
+        while (stream->taken_count == stream->filled_count && !stream->input_ended) {
+            pthread_cond_wait(&stream->ready_cond, &stream->mutex);
+        }
+        if (stream->taken_count == stream->filled_count) {
+            break;
+        }
+        StreamBatch* batch = &stream->batches[stream->taken_count % stream->batches_count];
+        stream->taken_count++;
+        batch->state = SB_EVALUATING;
+        pthread_mutex_unlock(&stream->mutex);
+        batch->output_len = 0;
+        batch->failure_count = 0;
+        bool success = stream->batch_fn(batch, stream->batch_ctx);
+        pthread_mutex_lock(&stream->mutex);
+        if (!success) {
+            fprintf(stderr, "meval: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        batch->state = SB_DONE;
+        pthread_cond_broadcast(&stream->done_cond);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return NULL;
+}
+
+int run_stream_pipeline(StreamInput* input, uint32_t threads_count, StreamBatchFn batch_fn, void* batch_ctx) {
+    /* Runs every batch of 'input' through 'batch_fn' on 'threads_count' workers (0 for one per CPU), writing the output in order. Returns the exit status */
+    if (threads_count == 0) {
+        long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_count = online_cpus > 0 ? (uint32_t)MIN(online_cpus, 256) : 1;
+    }
+    Stream stream = {.mutex=PTHREAD_MUTEX_INITIALIZER, .ready_cond=PTHREAD_COND_INITIALIZER, .done_cond=PTHREAD_COND_INITIALIZER,
+        .batches_count=threads_count*2, .batch_fn=batch_fn, .batch_ctx=batch_ctx};
+    stream.batches = calloc(stream.batches_count, sizeof(StreamBatch));
+    pthread_t* workers = calloc(threads_count, sizeof(pthread_t));
+    if (stream.batches == NULL || workers == NULL) {
+        fprintf(stderr, "meval: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t started_count = 0;
+    for (; started_count < threads_count; started_count++) {
+        if (pthread_create(&workers[started_count], NULL, stream_worker_main, &stream) != 0) {
+            break;
+        }
+    }
+    if (started_count == 0) {
+        fprintf(stderr, "meval: cannot start worker threads\n");
+        return EXIT_FAILURE;
+    }
+
+    bool input_failed = false;
+    uint64_t written_count = 0;
+    uint64_t failure_count = 0;
+    pthread_mutex_lock(&stream.mutex);
+    while (!input->ended || written_count < stream.filled_count) {
+        // Fill every free batch, then write out the oldest once it is done.
+        while (!input->ended && stream.filled_count - written_count < stream.batches_count) {
+            StreamBatch* batch = &stream.batches[stream.filled_count % stream.batches_count];
+            pthread_mutex_unlock(&stream.mutex);
+            bool success = fill_stream_batch(input, batch);
+            pthread_mutex_lock(&stream.mutex);
+            if (!success) {
+                fprintf(stderr, "meval: cannot read input: %s\n", errno != 0 ? strerror(errno) : "out of memory");
+                input->ended = input_failed = true;
+                break;
+            }
+            if (batch->text_len > 0) {
+                batch->state = SB_READY;
+                stream.filled_count++;
+                pthread_cond_signal(&stream.ready_cond);
+            }
+        }
+        if (written_count == stream.filled_count) {
+            continue;
+        }
+        StreamBatch* batch = &stream.batches[written_count % stream.batches_count];
+        while (batch->state != SB_DONE) {
+            pthread_cond_wait(&stream.done_cond, &stream.mutex);
+        }
+        pthread_mutex_unlock(&stream.mutex);
+        fwrite(batch->output, 1, batch->output_len, stdout);
+        failure_count += batch->failure_count;
+        pthread_mutex_lock(&stream.mutex);
+        batch->state = SB_FREE;
+        written_count++;
+    }
+    // Signalled here, not in the loop, as the input may have ended before it (a CSV header with no rows).
+    stream.input_ended = true;
+    pthread_cond_broadcast(&stream.ready_cond);
+    pthread_mutex_unlock(&stream.mutex);
+    for (uint32_t i = 0; i < started_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    fflush(stdout);
+    for (uint32_t i = 0; i < stream.batches_count; i++) {
+        free(stream.batches[i].text);
+        free(stream.batches[i].output);
+        free(stream.batches[i].numbers);
+    }
+    free(stream.batches);
+    free(workers);
+    return (failure_count == 0 && !input_failed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_stream(const char* path, uint32_t threads_count) {
+    /* Evaluates every line of 'path' to stdout. Returns the exit status */
+    StreamInput input;
+    if (!open_stream_input(path, &input)) {
+        return EXIT_FAILURE;
+    }
+    int status = run_stream_pipeline(&input, threads_count, eval_stream_batch, NULL);
+    close_stream_input(&input);
+    return status;
+}
+
+/*
+ * CSV mode, '--expr' with '--csv'. The expression is compiled once, with the
+ *   header names as its variables, and bound to them. Each batch of rows is
+ *   parsed into one array per variable, only parsing the columns the
+ *   expression uses, then evaluated in a single batch call. Fields that are
+ *   not numbers (or missing) are NaN. Quoted fields may hold delimiters, but
+ *   not newlines.
+ */
+typedef struct {
+    const MEvalCompiledExpr* compiled_expr;
+    uint32_t* column_vars; // Index of each column among the variables 'compiled_expr' uses, UINT32_MAX for none.
+    uint32_t columns_count;
+    uint32_t* var_handles; // Handle of each used variable.
+    uint32_t vars_count;
+    uint32_t handles_count; // Of the environment, 'compiled_expr' is bound to.
+    char delimiter;
+} CsvContext;
+
+char* find_csv_field_end(char* field, char delimiter) {
+    /* Returns the delimiter (or terminator) ending the field at 'field' */
+    bool quoted = false;
+    char* c = field;
+    for (; *c != '\0' && (quoted || *c != delimiter); c++) {
+        if (*c == '"') {
+            quoted = !quoted;
+        }
+    }
+    return c;
+}
+
+double parse_csv_number(char* field, char* field_end) {
+    char saved_end = *field_end;
+    *field_end = '\0';
+    while (isspace((unsigned char)*field) || *field == '"') {
+        field++;
+    }
+    char* number_end = field;
+    double value = strtod(field, &number_end);
+    while (isspace((unsigned char)*number_end) || *number_end == '"') {
+        number_end++;
+    }
+    bool is_number = number_end != field && *number_end == '\0';
+    *field_end = saved_end;
+    return is_number ? value : NAN;
+}
+
+bool parse_csv_header(char* header, char delimiter, MEvalVarEnv* env, uint32_t** output_column_handles, uint32_t* output_columns_count) {
+    /* Adds every header name to 'env', and sets the handle of each column (MEVAL_VAR_ENV_NO_HANDLE for a repeated name). Returns false on an allocation failure */
+    uint32_t columns_count = 1;
+    for (char* c = find_csv_field_end(header, delimiter); *c != '\0'; c = find_csv_field_end(c + 1, delimiter)) {
+        columns_count++;
+    }
+    uint32_t* column_handles = malloc(columns_count*sizeof(uint32_t));
+    if (column_handles == NULL) {
+        return false;
+    }
+    char* field = header;
+    for (uint32_t column = 0; column < columns_count; column++) {
+        char* field_end = find_csv_field_end(field, delimiter);
+        char* name_start = field;
+        char* name_end = field_end;
+        while (name_start < name_end && (isspace((unsigned char)*name_start) || *name_start == '"')) {
+            name_start++;
+        }
+        while (name_end > name_start && (isspace((unsigned char)name_end[-1]) || name_end[-1] == '"')) {
+            name_end--;
+        }
+        char name[MEVAL_VAR_NAME_MAX_LEN] = {0};
+        snprintf(name, MIN(MEVAL_VAR_NAME_MAX_LEN, name_end - name_start + 1), "%s", name_start);
+        column_handles[column] = MEVAL_VAR_ENV_NO_HANDLE;
+        if (name[0] != '\0' && meval_var_env_find(env, name) == MEVAL_VAR_ENV_NO_HANDLE) {
+            MEvalError error;
+            column_handles[column] = meval_var_env_set(env, name, 0, &error);
+            if (column_handles[column] == MEVAL_VAR_ENV_NO_HANDLE) {
+                free(column_handles);
+                return false;
+            }
+        }
+        field = *field_end != '\0' ? field_end + 1 : field_end;
+    }
+    *output_column_handles = column_handles;
+    *output_columns_count = columns_count;
+    return true;
+}
+
+bool eval_csv_batch(StreamBatch* batch, void* ctx) {
+    const CsvContext* csv = ctx;
+    char* line = batch->text;
+    char* text_end = batch->text + batch->text_len;
+    size_t lines_count = 1;
+    for (char* c = line; (c = memchr(c, '\n', text_end - c)) != NULL; c++) {
+        lines_count++;
+    }
+    // 'batch->numbers' holds one array of 'lines_count' per used variable, then the results.
+    const double** columns = calloc(MAX(csv->handles_count, 1), sizeof(double*));
+    if (columns == NULL || !reserve_buffer((void**)&batch->numbers, &batch->numbers_capacity, (csv->vars_count + 1)*lines_count, sizeof(double))) {
+        free(columns);
+        return false;
+    }
+    for (uint32_t var = 0; var < csv->vars_count; var++) {
+        columns[csv->var_handles[var]] = batch->numbers + var*lines_count;
+    }
+    double* results = batch->numbers + csv->vars_count*lines_count;
+
+    size_t rows_count = 0;
+    while (line < text_end) {
+        char* row = next_stream_line(&line, text_end);
+        if (row[0] == '\0') { // Blank lines are not rows.
+            continue;
+        }
+        char* field = row;
+        for (uint32_t column = 0; column < csv->columns_count; column++) {
+            char* field_end = find_csv_field_end(field, csv->delimiter);
+            if (csv->column_vars[column] != UINT32_MAX) {
+                batch->numbers[csv->column_vars[column]*lines_count + rows_count] = parse_csv_number(field, field_end);
+            }
+            field = *field_end != '\0' ? field_end + 1 : field_end;
+        }
+        rows_count++;
+    }
+    MEvalError error;
+    bool success = meval_var_eval_bound_cexpr_batch(csv->compiled_expr, columns, rows_count, results, &error);
+    free(columns);
+    if (!success || !reserve_buffer((void**)&batch->output, &batch->output_capacity, rows_count*STREAM_RESULT_MAX_LEN, 1)) {
+        return false;
+    }
+    for (size_t row = 0; row < rows_count; row++) {
+        batch->output_len += snprintf(batch->output + batch->output_len, STREAM_RESULT_MAX_LEN, "%.17g\n", results[row]);
+    }
+    return true;
+}
+
+int run_csv(const char* expr, const char* path, char delimiter, uint32_t threads_count) {
+    /* Evaluates 'expr' over every row of the CSV file 'path', printing one result per row. Returns the exit status */
+    StreamInput input;
+    if (!open_stream_input(path, &input)) {
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_FAILURE;
+    StreamBatch header_batch = {0};
+    uint32_t* column_handles = NULL;
+    CsvContext csv = {.delimiter=delimiter};
+    MEvalError error;
+    MEvalCompiledExpr* compiled_expr = NULL;
+    MEvalVarEnv* env = meval_var_env_create(0, &error);
+    if (env == NULL || !fill_stream_batch(&input, &header_batch)) {
+        fprintf(stderr, "meval: cannot read input: %s\n", errno != 0 ? strerror(errno) : "out of memory");
+        goto cleanup;
+    }
+    if (header_batch.text_len == 0) {
+        fprintf(stderr, "meval: the CSV input has no header\n");
+        goto cleanup;
+    }
+    // The rows read along with the header go back in front of the carried over partial line.
+    char* rows = header_batch.text;
+    char* header = next_stream_line(&rows, header_batch.text + header_batch.text_len);
+    size_t rows_len = rows < header_batch.text + header_batch.text_len ? header_batch.text + header_batch.text_len - rows : 0;
+    if (!reserve_buffer((void**)&input.carry, &input.carry_capacity, rows_len + input.carry_len, 1)) {
+        fprintf(stderr, "meval: out of memory\n");
+        goto cleanup;
+    }
+    memmove(input.carry + rows_len, input.carry, input.carry_len);
+    memcpy(input.carry, rows, rows_len);
+    input.carry_len += rows_len;
+
+    if (!parse_csv_header(header, delimiter, env, &column_handles, &csv.columns_count)) {
+        fprintf(stderr, "meval: out of memory\n");
+        goto cleanup;
+    }
+    compiled_expr = meval_var_compile_env(expr, env, &error);
+    if (error.type == MEVAL_NO_ERROR) {
+        meval_var_bind_cexpr_env(compiled_expr, env, &error);
+    }
+    if (error.type != MEVAL_NO_ERROR) {
+        fprintf(stderr, "meval: '%s': %s\n", expr, error.message);
+        goto cleanup;
+    }
+    csv.compiled_expr = compiled_expr;
+    csv.handles_count = meval_var_env_count(env);
+    csv.column_vars = malloc(csv.columns_count*sizeof(uint32_t));
+    csv.var_handles = malloc(MAX(meval_cexpr_var_count(compiled_expr), 1)*sizeof(uint32_t));
+    if (csv.column_vars == NULL || csv.var_handles == NULL) {
+        fprintf(stderr, "meval: out of memory\n");
+        goto cleanup;
+    }
+    for (uint32_t column = 0; column < csv.columns_count; column++) { // Columns the expression does not use are never parsed.
+        csv.column_vars[column] = UINT32_MAX;
+        for (uint32_t var_id = 0; column_handles[column] != MEVAL_VAR_ENV_NO_HANDLE && var_id < meval_cexpr_var_count(compiled_expr); var_id++) {
+            if (strcmp(meval_cexpr_var_name(compiled_expr, var_id), meval_var_env_name(env, column_handles[column])) == 0) {
+                csv.var_handles[csv.vars_count] = column_handles[column];
+                csv.column_vars[column] = csv.vars_count++;
+                break;
+            }
+        }
+    }
+    status = run_stream_pipeline(&input, threads_count, eval_csv_batch, &csv);
+
+cleanup:
+    free(header_batch.text);
+    free(column_handles);
+    free(csv.column_vars);
+    free(csv.var_handles);
+    meval_free_compiled_expr(&compiled_expr);
+    meval_var_env_free(&env);
+    close_stream_input(&input);
+    return status;
+}
+
 void print_usage(const char* program_name) {
     printf("Usage: %s [expr]...\n", program_name);
+    printf("Usage: %s --stream [--threads N] [file]\n", program_name);
+    printf("Usage: %s --expr expr --csv file [--delimiter c] [--threads N]\n", program_name);
     printf("Usage: %s [--help | --version]\n", program_name);
+    printf("  --stream  Evaluates every line of file (or stdin), an expression optionally followed by ';' and its\n");
+    printf("            variables as 'name=value ...'. Prints one result or error line per input line, in order.\n");
+    printf("  --csv     Evaluates expr for every row of the CSV file (or stdin, for '-'), its header naming the\n");
+    printf("            variables. Prints one result per row.\n");
 }
 void print_version(void) {
     printf("(libmeval) MEval Version: %d.%d\n", MEVAL_VERSION_MAJOR, MEVAL_VERSION_MINOR);
@@ -136,6 +669,44 @@ int main(int argc, char* argv[]) {
             } else if (strcmp(argv[i], "--version") == 0 || strcmp(argv[i], "-v") == 0) {
                 print_version();
                 exit(EXIT_SUCCESS);
+            } else if (strcmp(argv[i], "--stream") == 0) {
+                const char* path = NULL;
+                uint32_t threads_count = 0;
+                for (i++; i < argc; i++) {
+                    if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+                        threads_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+                    } else if (path == NULL) {
+                        path = argv[i];
+                    } else {
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                exit(run_stream(path, threads_count));
+            } else if (strcmp(argv[i], "--expr") == 0 || strcmp(argv[i], "--csv") == 0) {
+                const char* expr = NULL;
+                const char* path = NULL;
+                char delimiter = ',';
+                uint32_t threads_count = 0;
+                for (; i < argc; i++) {
+                    if (strcmp(argv[i], "--expr") == 0 && i+1 < argc) {
+                        expr = argv[++i];
+                    } else if (strcmp(argv[i], "--csv") == 0 && i+1 < argc) {
+                        path = argv[++i];
+                    } else if (strcmp(argv[i], "--delimiter") == 0 && i+1 < argc && strlen(argv[i+1]) == 1) {
+                        delimiter = argv[++i][0];
+                    } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+                        threads_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+                    } else {
+                        print_usage(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                if (expr == NULL || path == NULL) {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                exit(run_csv(expr, path, delimiter, threads_count));
             } else {
                 double answer = meval(argv[i], &error);
                 if (error.type == MEVAL_NO_ERROR) {